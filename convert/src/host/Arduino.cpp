@@ -0,0 +1,62 @@
+// Minimal Arduino/AVR shim for building Squawk on a PC
+
+#include "Arduino.h"
+
+uint8_t squawk_host_io[0x100];
+
+// SPI SRAM stand-in, in sequential mode after power-up like the 23LC1024
+uint8_t squawk_host_spiram[0x20000];
+uint8_t squawk_host_spiram_cs = 9;
+squawk_host_spdr_t squawk_host_spdr;
+
+static bool     spiram_selected;
+static uint8_t  spiram_mode = 0x40;
+static uint8_t  spiram_command;
+static uint8_t  spiram_count;       // Bytes received since selected
+static uint32_t spiram_address;
+static uint8_t  spiram_out = 0xFF;  // Byte sent back
+
+void pinMode(uint8_t pin, uint8_t mode) {
+  (void)pin;
+  (void)mode;
+}
+
+void digitalWrite(uint8_t pin, uint8_t value) {
+  if(pin != squawk_host_spiram_cs) return;
+  spiram_selected = !value;
+  spiram_count    = 0;
+}
+
+squawk_host_spdr_t &squawk_host_spdr_t::operator=(uint8_t data) {
+  uint8_t count = spiram_count;
+  SPSR |= _BV(SPIF);
+  spiram_out = 0xFF;
+  if(!spiram_selected) return *this;
+  if(count != 0xFF) spiram_count++;
+  if(count == 0) {
+    spiram_command = data;
+  } else if(spiram_command == 0x01) {
+    // WRMR
+    if(count == 1) spiram_mode = data & 0xC0;
+  } else if(spiram_command == 0x05) {
+    // RDMR
+    spiram_out = spiram_mode;
+  } else if(spiram_command == 0x02 || spiram_command == 0x03) {
+    // WRITE and READ: 3 address bytes, then data - just one byte in byte
+    // mode, wrapping around a 32 byte page in page mode
+    if(count <= 3) {
+      spiram_address = ((spiram_address << 8) | data) & 0x1FFFF;
+      return *this;
+    }
+    if(spiram_mode == 0x00 && count > 4) return *this;
+    if(spiram_command == 0x03) spiram_out = squawk_host_spiram[spiram_address];
+    else                       squawk_host_spiram[spiram_address] = data;
+    if(spiram_mode == 0x80) spiram_address = (spiram_address & ~0x1FUL) | ((spiram_address + 1) & 0x1F);
+    else                    spiram_address = (spiram_address + 1) & 0x1FFFF;
+  }
+  return *this;
+}
+
+squawk_host_spdr_t::operator uint8_t() const {
+  return spiram_out;
+}
@@ -0,0 +1,108 @@
+// Minimal Arduino/AVR shim for building Squawk on a PC
+//
+// Lets libraries/Squawk/Squawk.cpp compile unmodified with a host compiler.
+// Emulates just enough of an ATmega328P @ 16MHz for begin(), play() and
+// squawk_playroutine() to run: I/O registers are plain memory, PROGMEM is
+// ordinary memory and interrupts are never taken (the caller drives the
+// sample grinder, see SQUAWK_CONSTRUCT_ISR in Squawk.h).
+
+#ifndef _SQUAWK_HOST_ARDUINO_H_
+#define _SQUAWK_HOST_ARDUINO_H_
+#include <stddef.h>
+#include <stdint.h>
+#include <stdlib.h>
+#include <string.h>
+
+// Tells Squawk.h to use the portable sample grinder
+#define SQUAWK_HOST
+
+// Part being emulated
+#ifndef __AVR_ATmega328P__
+#define __AVR_ATmega328P__
+#endif
+#ifndef F_CPU
+#define F_CPU 16000000UL
+#endif
+
+typedef uint16_t word;
+typedef uint8_t  byte;
+typedef bool     boolean;
+
+// Program memory is just memory
+#define PROGMEM
+#define pgm_read_byte(P) (*(const uint8_t *)(P))
+#define pgm_read_word(P) (*(const uint16_t *)(P))
+#define pgm_read_ptr(P)  (*(const void * const *)(P))
+
+// Interrupts are never taken asynchronously on host
+#define cli()
+#define sei()
+#define _BV(B) (1 << (B))
+
+// I/O space, addressed like avr-libc's _SFR_MEM8/_SFR_MEM16
+extern uint8_t squawk_host_io[0x100];
+#define _SFR_MEM8(A)  (squawk_host_io[A])
+#define _SFR_MEM16(A) (*(uint16_t *)&squawk_host_io[A])
+
+#define DDRB   _SFR_MEM8(0x24)
+#define PORTB  _SFR_MEM8(0x25)
+#define DDRC   _SFR_MEM8(0x27)
+#define PORTC  _SFR_MEM8(0x28)
+#define DDRD   _SFR_MEM8(0x2A)
+#define PORTD  _SFR_MEM8(0x2B)
+#define TCCR0A _SFR_MEM8(0x44)
+#define TCCR0B _SFR_MEM8(0x45)
+#define OCR0A  _SFR_MEM8(0x47)
+#define OCR0B  _SFR_MEM8(0x48)
+#define TIMSK0 _SFR_MEM8(0x6E)
+#define TIMSK1 _SFR_MEM8(0x6F)
+#define TCCR1A _SFR_MEM8(0x80)
+#define TCCR1B _SFR_MEM8(0x81)
+#define TCNT1  _SFR_MEM16(0x84)
+#define OCR1A  _SFR_MEM16(0x88)
+#define OCR1AL _SFR_MEM8(0x88)
+#define OCR1AH _SFR_MEM8(0x89)
+#define TCCR2A _SFR_MEM8(0xB0)
+#define TCCR2B _SFR_MEM8(0xB1)
+#define OCR2A  _SFR_MEM8(0xB3)
+#define OCR2B  _SFR_MEM8(0xB4)
+
+// Timer1 doesn't run on host: its count stays 0 and, as flags are cleared
+// by writing ones, its flags always read as clear
+#define TIFR1  (_SFR_MEM8(0x36) = 0, _SFR_MEM8(0x36))
+
+#define OCIE1A 1
+#define OCF1A  1
+#define TOV1   0
+
+// Digital pins only matter to the SPI SRAM stand-in below
+#define LOW    0
+#define HIGH   1
+#define INPUT  0
+#define OUTPUT 1
+void pinMode(uint8_t pin, uint8_t mode);
+void digitalWrite(uint8_t pin, uint8_t value);
+
+// SPI, with a stand-in 23LC1024 SPI SRAM holding squawk_host_spiram on chip
+// select pin squawk_host_spiram_cs (9 by default): writing SPDR clocks a
+// byte out to it and completes at once, SPDR then reads the byte it sent back
+struct squawk_host_spdr_t {
+  squawk_host_spdr_t &operator=(uint8_t data);
+  operator uint8_t() const;
+};
+extern squawk_host_spdr_t squawk_host_spdr;
+extern uint8_t squawk_host_spiram[0x20000];
+extern uint8_t squawk_host_spiram_cs;
+
+#define SPCR  _SFR_MEM8(0x4C)
+#define SPSR  _SFR_MEM8(0x4D)
+#define SPDR  squawk_host_spdr
+
+#define SPIF  7
+#define SPE   6
+#define MSTR  4
+#define SPR1  1
+#define SPR0  0
+#define SPI2X 0
+
+#endif
@@ -89,6 +89,7 @@ bool confirm(char *str, int argc) {
 static void print_use(char**argv) {
   printf("Usage:\n\t%s -? [input].mod [output].c\n", argv[0]);
   printf("-? is either -f for SD card file or -a for a Melody array\n");
+  printf("add w (-fw, -aw) to have instrument numbers pick wave tables, with 8xx\n");
   printf("Example\n\t%s -f melody.mod melody.sqm\n", argv[0]);
 }
 
@@ -99,6 +100,7 @@ int main(int argc,char**argv) {
   size_t filesize;
   char name[24];
   unsigned int n, mode = 0;
+  bool waves = false;
   uint8_t patterns = 0;
   
 #ifndef WIN32
@@ -117,6 +119,7 @@ int main(int argc,char**argv) {
         } else if(argv[1][1] == 'a' || argv[1][1] == 'A') {
           mode = 2;
         }
+        if(argv[1][2] == 'w' || argv[1][2] == 'W') waves = true;
       }
     }
 #ifndef WIN32
@@ -243,6 +246,9 @@ int main(int argc,char**argv) {
   uint8_t *cell = data + sizeof(protracker_head_t);
 
   uint8_t fxc[4], fxp[4], note[4], sample[4];
+  uint8_t instrument[4] = { 0, 0, 0, 0 };  // Wave table set by the last 8xx
+  uint8_t pending[4] = { 0, 0, 0, 0 };     // Wave table change not written yet
+  uint8_t pending_row[4];
   uint16_t period;
   uint8_t temp, hout;
   
@@ -271,6 +277,8 @@ int main(int argc,char**argv) {
 
   // Write patterns
   for(ptn = 0; ptn < patterns; ptn++) {
+    // Patterns can be entered from any order, so no wave table carries over
+    for(chn = 0; chn < 4; chn++) instrument[chn] = pending[chn] = 0;
     for(row = 0; row < 64; row++) {
       for(chn = 0; chn < 4; chn++) {
         
@@ -323,7 +331,9 @@ int main(int argc,char**argv) {
         } else if(fxc[chn] == 0xEF) {
           printf("[%02X][%02X][%01X] Funk-it not supported\n", ptn, row, chn);
         } else if(fxc[chn] == 0x80) {
+          // Dropped, as 8xx picks a wave table in Squawk
           printf("[%02X][%02X][%01X] Panning not supported\n", ptn, row, chn);
+          fxc[chn] = fxp[chn] = 0;
         } else if(fxc[chn] == 0xE5) {
           printf("[%02X][%02X][%01X] Fine-tune is wonky by design\n", ptn, row, chn);
         } else if(fxc[chn] == 0xE6) {
@@ -334,6 +344,24 @@ int main(int argc,char**argv) {
           printf("[%02X][%02X][%01X] Sample offset not supported\n", ptn, row, chn);
         }
 
+        // Instrument numbers to wave tables, with 8xx where the cell has no
+        // effect, or on the next cell of the channel that has none
+        if(waves && chn != 3) {
+          if(sample[chn]) {
+            pending[chn] = sample[chn] != instrument[chn] ? sample[chn] : 0;
+            pending_row[chn] = row;
+          }
+          if(pending[chn] && fxc[chn] == 0 && fxp[chn] == 0) {
+            if(row != pending_row[chn]) {
+              printf("[%02X][%02X][%01X] Wave table change moved to row %02X\n", ptn, pending_row[chn], chn, row);
+            }
+            fxc[chn] = 0x80;
+            fxp[chn] = pending[chn] - 1;
+            instrument[chn] = pending[chn];
+            pending[chn] = 0;
+          }
+        }
+
         // Re-nibblify - it's a word!
         if(chn != 3) {
           if((fxc[chn] & 0xF0) == 0xE0) {
@@ -424,6 +452,11 @@ int main(int argc,char**argv) {
       HOUT( note[1] | (sample[1] == 0 ? 0x00 : 0x80) );
       HOUT( note[2] | (sample[2] == 0 ? 0x00 : 0x80) );
     }
+    for(chn = 0; chn < 3; chn++) {
+      if(pending[chn]) {
+        printf("[%02X][%02X][%01X] No room for wave table change\n", ptn, pending_row[chn], chn);
+      }
+    }
   }
   if(mode == 2) {
     // Squawk melody end
@@ -0,0 +1,265 @@
+// Squawk cycle benchmark
+//
+// Runs sketches/Squawk_bench firmware inside simavr and measures, in CPU
+// cycles, every sample interrupt and every squawk_playroutine() tick:
+//   isr  - sample grinder, from the interrupt vector to reti, not counting
+//          the playroutine it may call
+//   tick - squawk_playroutine(), not counting interrupts nested inside it
+//   cpu  - share of all cycles spent in the sample interrupt, playroutine
+//          included
+// Results are printed as one JSON object per line. Given a baseline file
+// written by an earlier run, regressions beyond a tolerance (and results it
+// has none for) fail with exit code 2. Normally invoked through
+// squawk-bench.sh.
+//
+// Build (needs simavr and libelf):
+//   gcc -O2 -o squawk-bench squawk-bench.c -lsimavr -lelf
+
+#include <stdlib.h>
+#include <stdio.h>
+#include <stdint.h>
+#include <stdbool.h>
+#include <string.h>
+#include <unistd.h>
+#include <simavr/sim_avr.h>
+#include <simavr/sim_elf.h>
+
+#define OP_RET  0x9508
+#define OP_RETI 0x9518
+
+// Compared fields of a result line, from "isr" onwards
+#define FIELDS "\"isr\": {\"count\": %*u, \"min\": %*u, \"mean\": %lf, \"p99\": %*u, \"max\": %*u}, " \
+               "\"tick\": {\"count\": %*u, \"min\": %*u, \"mean\": %lf, \"p99\": %lf, \"max\": %lf}, \"cpu\": %lf"
+
+// Interrupt or playroutine call in progress
+typedef struct {
+  bool     play;     // squawk_playroutine() rather than an interrupt
+  uint8_t  vector;   // interrupt vector number
+  uint16_t sp;       // stack pointer after entry
+  uint64_t start;    // cycle count at entry
+  uint64_t nested;   // cycles spent in frames nested inside this one
+} frame_t;
+
+// Measurements of one kind
+typedef struct {
+  uint32_t *cycles;
+  uint32_t count, size;
+} series_t;
+
+typedef struct {
+  uint32_t min, p99, max;
+  double   mean;
+} summary_t;
+
+static void record(series_t *s, uint32_t cycles) {
+  if(s->count == s->size) {
+    s->size = s->size ? s->size * 2 : 4096;
+    s->cycles = realloc(s->cycles, s->size * sizeof(uint32_t));
+    if(!s->cycles) {
+      fprintf(stderr, "Out of memory\n");
+      exit(1);
+    }
+  }
+  s->cycles[s->count++] = cycles;
+}
+
+static int compare_u32(const void *a, const void *b) {
+  uint32_t x = *(const uint32_t*)a, y = *(const uint32_t*)b;
+  return x < y ? -1 : x > y;
+}
+
+static summary_t summarize(series_t *s) {
+  summary_t sum = { 0, 0, 0, 0.0 };
+  uint64_t total = 0;
+  uint32_t n;
+  if(!s->count) return sum;
+  qsort(s->cycles, s->count, sizeof(uint32_t), compare_u32);
+  for(n = 0; n < s->count; n++) total += s->cycles[n];
+  sum.min  = s->cycles[0];
+  sum.max  = s->cycles[s->count - 1];
+  sum.p99  = s->cycles[(uint32_t)((s->count - 1) * 0.99)];
+  sum.mean = (double)total / s->count;
+  return sum;
+}
+
+static uint16_t get_sp(avr_t *avr) {
+  return avr->data[R_SPL] | (avr->data[R_SPH] << 8);
+}
+
+// Finds the result for module/rate in a baseline file and compares
+static int check_baseline(const char *filename, const char *line, const char *module,
+                          unsigned rate, double tolerance) {
+  char key[128], text[1024];
+  double base[5], now[5];
+  const char *names[5] = { "isr.mean", "tick.mean", "tick.p99", "tick.max", "cpu" };
+  int n, regressions = 0;
+  FILE *f;
+
+  f = fopen(filename, "r");
+  if(!f) {
+    fprintf(stderr, "Unable to open baseline %s\n", filename);
+    return 1;
+  }
+  snprintf(key, sizeof(key), "{\"module\": \"%s\", \"rate\": %u,", module, rate);
+  while(fgets(text, sizeof(text), f)) {
+    const char *p_obj = strstr(text, key);
+    if(!p_obj) continue;
+    if(sscanf(strstr(p_obj, "\"isr\""), FIELDS, &base[0], &base[1], &base[2], &base[3], &base[4]) == 5 &&
+       sscanf(strstr(line,  "\"isr\""), FIELDS, &now[0],  &now[1],  &now[2],  &now[3],  &now[4])  == 5) {
+      for(n = 0; n < 5; n++) {
+        // Half a cycle of slack for rounding, none for the CPU share
+        if(now[n] > base[n] * (1.0 + tolerance / 100.0) + (n == 4 ? 0.0 : 0.5)) {
+          fprintf(stderr, "REGRESSION %s @ %uHz: %s %.2f -> %.2f\n", module, rate, names[n], base[n], now[n]);
+          regressions++;
+        }
+      }
+    }
+    fclose(f);
+    return regressions ? 2 : 0;
+  }
+  fclose(f);
+  fprintf(stderr, "No baseline for %s @ %uHz\n", module, rate);
+  return 2;
+}
+
+static void print_use(char **argv) {
+  printf("Usage:\n\t%s [options] [firmware].elf [playroutine address]\n", argv[0]);
+  printf("Options:\n");
+  printf("\t-m [mcu]       simavr core (default atmega328p)\n");
+  printf("\t-f [hz]        CPU clock (default 16000000)\n");
+  printf("\t-r [hz]        sample rate the firmware was built for (default 32000)\n");
+  printf("\t-v [vector]    sample interrupt vector number (default 11, TIMER1_COMPA on 328P)\n");
+  printf("\t-n [vectors]   size of the vector table (default 26)\n");
+  printf("\t-s [seconds]   simulated time to measure (default 30)\n");
+  printf("\t-N [name]      module name to report (default firmware name)\n");
+  printf("\t-b [file]      baseline results to compare against\n");
+  printf("\t-x [percent]   tolerance against the baseline (default 2)\n");
+  printf("Example\n\t%s -r 32000 Squawk_bench.ino.elf 0x$(avr-nm ... | grep squawk_playroutine)\n", argv[0]);
+}
+
+int main(int argc, char **argv) {
+  const char *mcu = "atmega328p", *module = NULL, *baseline = NULL;
+  uint32_t f_cpu = 16000000, vectors = 26;
+  unsigned rate = 32000, vector = 11;
+  double seconds = 30.0, tolerance = 2.0;
+  uint32_t playroutine;
+  elf_firmware_t firmware;
+  avr_t *avr;
+  frame_t stack[32];
+  int depth = 0, opt;
+  uint64_t begin = 0, end = 0, busy = 0, cycle;
+  series_t isr = { NULL, 0, 0 }, tick = { NULL, 0, 0 };
+  summary_t s_isr, s_tick;
+  char line[1024];
+
+  while((opt = getopt(argc, argv, "m:f:r:v:n:s:N:b:x:")) != -1) {
+    switch(opt) {
+      case 'm': mcu       = optarg;                  break;
+      case 'f': f_cpu     = strtoul(optarg, NULL, 0); break;
+      case 'r': rate      = strtoul(optarg, NULL, 0); break;
+      case 'v': vector    = strtoul(optarg, NULL, 0); break;
+      case 'n': vectors   = strtoul(optarg, NULL, 0); break;
+      case 's': seconds   = atof(optarg);             break;
+      case 'N': module    = optarg;                  break;
+      case 'b': baseline  = optarg;                  break;
+      case 'x': tolerance = atof(optarg);             break;
+      default:  print_use(argv); return 1;
+    }
+  }
+  if(argc - optind != 2) {
+    print_use(argv);
+    return 1;
+  }
+  if(!module) module = argv[optind];
+  playroutine = strtoul(argv[optind + 1], NULL, 16);
+
+  memset(&firmware, 0, sizeof(firmware));
+  if(elf_read_firmware(argv[optind], &firmware)) {
+    fprintf(stderr, "Unable to read firmware %s\n", argv[optind]);
+    return 1;
+  }
+  avr = avr_make_mcu_by_name(mcu);
+  if(!avr) {
+    fprintf(stderr, "Unknown MCU %s\n", mcu);
+    return 1;
+  }
+  avr_init(avr);
+  firmware.frequency = f_cpu;
+  avr_load_firmware(avr, &firmware);
+  avr->frequency = f_cpu;
+
+  for(;;) {
+    avr_flashaddr_t pc = avr->pc;
+    uint16_t opcode = avr->flash[pc] | (avr->flash[pc + 1] << 8);
+    uint16_t sp = get_sp(avr);
+    int state = avr_run(avr);
+    if(state == cpu_Done || state == cpu_Crashed) {
+      fprintf(stderr, "Simulation stopped unexpectedly\n");
+      return 1;
+    }
+    cycle = avr->cycle;
+
+    // Returning from the innermost interrupt or playroutine call
+    if(depth && ((opcode == OP_RETI && !stack[depth - 1].play) ||
+                 (opcode == OP_RET  &&  stack[depth - 1].play && sp == stack[depth - 1].sp))) {
+      frame_t *p_frame = &stack[--depth];
+      uint64_t cycles = cycle - p_frame->start;
+      if(depth) stack[depth - 1].nested += cycles;
+      if(begin) {
+        if(p_frame->play) {
+          record(&tick, cycles - p_frame->nested);
+        } else if(p_frame->vector == vector) {
+          // Not counting the playroutine, nor anything nested before it
+          record(&isr, cycles - p_frame->nested);
+          if(!depth) busy += cycles;
+        }
+      }
+      if(end && !depth && cycle >= end) break;
+    }
+
+    // Entering an interrupt (the CPU jumped into the vector table)
+    if(avr->pc && avr->pc < vectors * 4) {
+      if(depth == 32) {
+        fprintf(stderr, "Interrupts nested too deep\n");
+        return 1;
+      }
+      stack[depth].play   = false;
+      stack[depth].vector = avr->pc / 4;
+      stack[depth].sp     = get_sp(avr);
+      stack[depth].start  = cycle;
+      stack[depth].nested = 0;
+      depth++;
+    }
+
+    // Entering the playroutine
+    if(avr->pc == playroutine && depth < 32) {
+      stack[depth].play   = true;
+      stack[depth].vector = 0;
+      stack[depth].sp     = get_sp(avr);
+      stack[depth].start  = cycle;
+      stack[depth].nested = 0;
+      depth++;
+      // Measurements start with the first tick
+      if(!begin) {
+        begin = cycle;
+        end   = begin + (uint64_t)(seconds * f_cpu);
+      }
+    }
+  }
+
+  s_isr  = summarize(&isr);
+  s_tick = summarize(&tick);
+  snprintf(line, sizeof(line),
+    "{\"module\": \"%s\", \"rate\": %u, \"mcu\": \"%s\", \"f_cpu\": %u, \"seconds\": %.1f, "
+    "\"isr\": {\"count\": %u, \"min\": %u, \"mean\": %.2f, \"p99\": %u, \"max\": %u}, "
+    "\"tick\": {\"count\": %u, \"min\": %u, \"mean\": %.2f, \"p99\": %u, \"max\": %u}, \"cpu\": %.4f}",
+    module, rate, mcu, f_cpu, seconds,
+    isr.count, s_isr.min, s_isr.mean, s_isr.p99, s_isr.max,
+    tick.count, s_tick.min, s_tick.mean, s_tick.p99, s_tick.max,
+    (double)busy / (double)(cycle - begin));
+  printf("%s\n", line);
+
+  free(isr.cycles);
+  free(tick.cycles);
+  return baseline ? check_baseline(baseline, line, module, rate, tolerance) : 0;
+}
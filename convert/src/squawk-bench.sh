@@ -0,0 +1,96 @@
+#!/bin/sh
+# Squawk cycle benchmark driver
+#
+# Builds sketches/Squawk_bench for every module in convert/music at every
+# benchmarked sample rate, runs each build through squawk-bench (simavr) and
+# collects the results in a JSON file. Any result that regressed against the
+# baseline - the one given with -b, or else squawk-bench.json next to this
+# script (squawk-bench-buffered.json with -B) - makes the script fail, as
+# does a missing baseline. None has been committed yet: record one with -u,
+# which makes the results the new baseline instead, and commit it. With -B,
+# the buffered sample grinder is measured instead (modules are reported as
+# name-buffered).
+#
+# Runs squawk-check on the PC first, and fails if it does. Needs
+# arduino-cli (with the arduino:avr core), avr-nm, a C and C++ compiler and
+# simavr. Usage:
+#   squawk-bench.sh [-b baseline.json] [-o results.json] [-s seconds] [-B] [-u]
+
+set -e
+
+SRC=$(cd "$(dirname "$0")" && pwd)
+ROOT=$(cd "$SRC/../.." && pwd)
+RATES="8000 16000 22050 32000 44100"
+FQBN=arduino:avr:uno
+MCU=atmega328p
+OUTPUT=bench.json
+BASELINE=
+UPDATE=
+LENGTH=30
+FLAGS=
+SUFFIX=
+
+while getopts "b:o:s:Bu" opt; do
+  case $opt in
+    b) BASELINE=$(cd "$(dirname "$OPTARG")" && pwd)/$(basename "$OPTARG") ;;
+    o) OUTPUT=$OPTARG ;;
+    s) LENGTH=$OPTARG ;;
+    B) FLAGS=-DSQUAWK_BENCH_BUFFERED; SUFFIX=-buffered ;;
+    u) UPDATE=1 ;;
+    *) echo "Usage: $0 [-b baseline.json] [-o results.json] [-s seconds] [-B] [-u]"; exit 1 ;;
+  esac
+done
+
+WORK=$(mktemp -d)
+trap 'rm -rf "$WORK"' EXIT
+
+# Host checks first, there is no point timing a playroutine that is wrong
+c++ -O2 -I "$SRC/host" -I "$ROOT/libraries/Squawk" -o "$WORK/squawk-check" \
+  "$SRC/squawk-check.cpp" "$SRC/host/Arduino.cpp" "$ROOT/libraries/Squawk/Squawk.cpp"
+"$WORK/squawk-check" > "$WORK/check.txt" || { cat "$WORK/check.txt" >&2; exit 1; }
+
+[ -n "$BASELINE" ] || BASELINE=$SRC/squawk-bench$SUFFIX.json
+if [ -n "$UPDATE" ]; then
+  OUTPUT=$BASELINE
+  BASELINE=
+elif [ ! -f "$BASELINE" ]; then
+  echo "No baseline $BASELINE - none is committed yet, record one with -u" >&2
+  exit 2
+fi
+
+cc -O2 -o "$WORK/mod2squawk" "$SRC/mod2squawk.c"
+cc -O2 -o "$WORK/squawk-bench" "$SRC/squawk-bench.c" -lsimavr -lelf
+
+mkdir -p "$WORK/Squawk_bench"
+cp "$ROOT/sketches/Squawk_bench/Squawk_bench.ino" "$WORK/Squawk_bench/"
+
+FAILED=0
+FIRST=1
+echo "[" > "$WORK/results.json"
+for MOD in "$ROOT"/convert/music/*.mod; do
+  NAME=$(basename "$MOD" .mod)$SUFFIX
+  "$WORK/mod2squawk" -a "$MOD" "$WORK/Squawk_bench/melody.h" > /dev/null
+  for RATE in $RATES; do
+    arduino-cli compile -b $FQBN --libraries "$ROOT/libraries" \
+      --build-property "compiler.cpp.extra_flags=-DSQUAWK_BENCH_RATE=$RATE $FLAGS" \
+      --output-dir "$WORK/build" "$WORK/Squawk_bench" > /dev/null
+    ELF="$WORK/build/Squawk_bench.ino.elf"
+    PLAY=$(avr-nm "$ELF" | awk '$3 == "squawk_playroutine" { print $1 }')
+    STATUS=0
+    RESULT=$("$WORK/squawk-bench" -m $MCU -r $RATE -s "$LENGTH" -N "$NAME" \
+      ${BASELINE:+-b "$BASELINE"} "$ELF" "$PLAY") || STATUS=$?
+    [ $STATUS -eq 1 ] && exit 1
+    [ $STATUS -eq 2 ] && FAILED=1
+    [ $FIRST -eq 1 ] || echo "," >> "$WORK/results.json"
+    printf "%s" "$RESULT" >> "$WORK/results.json"
+    FIRST=0
+    echo "$RESULT"
+  done
+done
+printf "\n]\n" >> "$WORK/results.json"
+cp "$WORK/results.json" "$OUTPUT"
+
+if [ $FAILED -ne 0 ]; then
+  echo "Performance regressions found, see above" >&2
+  exit 2
+fi
@@ -0,0 +1,50 @@
+// Squawk host check
+//
+// Checks the parts of libraries/Squawk/Squawk.cpp that approximate what
+// they replace, on a PC: the playroutine's division-free frequency
+// calculation (squawk_freq()) against plain division, for every period at
+// common sample rates and tunings. Fails if any is off by more than one.
+// squawk-bench.sh runs it before benchmarking.
+//
+// Build (from convert/src):
+//   g++ -O2 -I host -I ../../libraries/Squawk -o squawk-check squawk-check.cpp
+//       host/Arduino.cpp ../../libraries/Squawk/Squawk.cpp
+
+#include <stdio.h>
+#include "Squawk.h"
+
+// Host sample grinder, never run - Squawk.cpp needs one to link
+SQUAWK_CONSTRUCT_ISR(SQUAWK_PWM_PIN3)
+
+// Compares squawk_freq() to the division it replaces, for every period the
+// playroutine clamps to, returns the largest difference
+static uint16_t check_freq(uint16_t rate, float tuning) {
+  uint32_t tuning_long;
+  uint16_t period, error, max_error = 0;
+  Squawk.beginEx(rate);
+  Squawk.tune(tuning);
+  tuning_long = (long)(((float)3669213184.0 / (float)rate) * tuning);
+  for(period = 28; period <= 3424; period++) {
+    uint16_t expect = tuning_long / period, freq = squawk_freq(period);
+    error = freq > expect ? freq - expect : expect - freq;
+    if(error > max_error) max_error = error;
+  }
+  printf("%5u Hz, tuning %.2f: max error %u\n", rate, tuning, max_error);
+  return max_error;
+}
+
+int main() {
+  // Common sample rates, at a few tunings
+  const uint16_t rates[] = { 8000, 11025, 16000, 22050, 32000, 44100 };
+  const float tunings[] = { 0.5, 1.0, 2.0 };
+  bool failed = false;
+  uint8_t n;
+  for(n = 0; n < sizeof(rates) / sizeof(rates[0]) * 3; n++) {
+    if(check_freq(rates[n / 3], tunings[n % 3]) > 1) failed = true;
+  }
+  if(failed) {
+    fprintf(stderr, "Frequency error above one LSB\n");
+    return 1;
+  }
+  return 0;
+}
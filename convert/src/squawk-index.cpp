@@ -0,0 +1,129 @@
+// Squawk seek index generator
+//
+// Plays a melody through on a PC, using the real playroutine from
+// libraries/Squawk/Squawk.cpp, and writes it out again as a .sqm file with
+// a seek index in its meta data: the speed, volumes and effect memory at the
+// start of every order. With it, Squawk.seek() jumps to any order/row
+// without playing up to it first.
+//
+// The index is an 'I' chunk in the meta data area, which is a sequence of
+// chunks: a tag byte, a big endian 16-bit size, then that many bytes of
+// data. It holds SQUAWK_SNAPSHOT_SIZE bytes for every order, starting with
+// the speed - 0 for orders playback never reaches. Other chunks are kept.
+//
+// Output ending in .h, .c, .cpp, .ino or .txt is written as a Melody array,
+// which Squawk.play() takes the same as one generated by mod2squawk -a.
+//
+// Build (from convert/src):
+//   g++ -O2 -I host -I ../../libraries/Squawk -o squawk-index squawk-index.cpp
+//       squawk-load.cpp host/Arduino.cpp ../../libraries/Squawk/Squawk.cpp
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include "Squawk.h"
+#include "squawk-load.h"
+
+// Host sample grinder, never run - Squawk.cpp needs one to link
+SQUAWK_CONSTRUCT_ISR(SQUAWK_PWM_PIN3)
+
+static bool is_source(const char *filename) {
+  const char *p_ext = strrchr(filename, '.');
+  return p_ext && (!strcmp(p_ext, ".h") || !strcmp(p_ext, ".c") || !strcmp(p_ext, ".cpp") ||
+                   !strcmp(p_ext, ".ino") || !strcmp(p_ext, ".txt"));
+}
+
+int main(int argc, char **argv) {
+  uint8_t *melody, *out, *p_out, *index;
+  const uint8_t *p_meta = NULL, *p_body;
+  size_t size, n, meta = 0, chunk, body;
+  uint16_t index_size;
+  FILE *f;
+
+  if(argc != 3) {
+    printf("Usage:\n\t%s [input] [output]\n", argv[0]);
+    printf("[input] is a .sqm file, or a source file containing a Melody array\n");
+    printf("[output] is a .sqm file, or a source file to write a Melody array to\n");
+    printf("Example\n\t%s melody.sqm melody-indexed.sqm\n", argv[0]);
+    return 1;
+  }
+
+  melody = load_melody(argv[1], &size);
+  if(!melody || size < 2) {
+    fprintf(stderr, "Unable to open input file\n");
+    return 1;
+  }
+
+  // Find the meta data and the melody itself
+  if(melody[0] == 'S') {
+    meta   = size >= 6 ? (melody[4] << 8) | melody[5] : size;
+    p_meta = melody + 6;
+    p_body = p_meta + meta;
+  } else {
+    p_body = melody + 1;
+  }
+  if(p_body >= melody + size || *p_body > 64) {
+    fprintf(stderr, "Not a Squawk melody\n");
+    free(melody);
+    return 1;
+  }
+  body = melody + size - p_body;
+
+  Squawk.begin(32000);
+  Squawk.play(melody);
+  index = (uint8_t*)malloc(*p_body * SQUAWK_SNAPSHOT_SIZE + 1);
+  out   = (uint8_t*)malloc(size + 9 + *p_body * SQUAWK_SNAPSHOT_SIZE);
+  if(!index || !out) {
+    fprintf(stderr, "Out of memory\n");
+    free(melody);
+    return 1;
+  }
+  index_size = Squawk.index(index);
+
+  // Header, then the meta data chunks kept, then the new index
+  p_out = out;
+  memcpy(p_out, "SQM1", 4);
+  p_out += 6;
+  for(n = 0; n + 3 <= meta; n += chunk + 3) {
+    chunk = (p_meta[n + 1] << 8) | p_meta[n + 2];
+    if(n + 3 + chunk > meta) break;
+    if(p_meta[n] == 'I') continue;
+    memcpy(p_out, &p_meta[n], chunk + 3);
+    p_out += chunk + 3;
+  }
+  *p_out++ = 'I';
+  *p_out++ = index_size >> 8;
+  *p_out++ = index_size & 0xFF;
+  memcpy(p_out, index, index_size);
+  p_out += index_size;
+  meta = p_out - out - 6;
+  out[4] = meta >> 8;
+  out[5] = meta & 0xFF;
+  memcpy(p_out, p_body, body);
+  p_out += body;
+
+  f = fopen(argv[2], "wb");
+  if(!f) {
+    fprintf(stderr, "Unable to open output file\n");
+    free(melody);
+    return 1;
+  }
+  if(is_source(argv[2])) {
+    // Same layout as mod2squawk -a
+    fprintf(f, "Melody InsertTitleHere[] = {");
+    for(n = 0; n < (size_t)(p_out - out); n++) {
+      if(!(n & 15)) fprintf(f, "\n ");
+      fprintf(f, " 0x%02X,", out[n]);
+    }
+    fprintf(f, "\n};\n");
+  } else {
+    fwrite(out, 1, p_out - out, f);
+  }
+  fclose(f);
+  printf("Orders: %u, index: %u bytes\n", *p_body, index_size);
+
+  free(index);
+  free(out);
+  free(melody);
+  return 0;
+}
@@ -0,0 +1,92 @@
+// Squawk melody information
+//
+// Plays a melody through on a PC without generating any sound, using the
+// real playroutine from libraries/Squawk/Squawk.cpp (Squawk.scan()), and
+// reports how long it plays before starting over, where it loops back to
+// and, optionally, the time every row starts at. The cost of the heaviest
+// tick can only be measured on the Arduino, where Squawk.scan() reports it.
+//
+// Build (from convert/src):
+//   g++ -O2 -I host -I ../../libraries/Squawk -o squawk-info squawk-info.cpp
+//       squawk-load.cpp host/Arduino.cpp ../../libraries/Squawk/Squawk.cpp
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <time.h>
+#include <unistd.h>
+#include "Squawk.h"
+#include "squawk-load.h"
+
+// Host sample grinder, never run - Squawk.cpp needs one to link
+SQUAWK_CONSTRUCT_ISR(SQUAWK_PWM_PIN3)
+
+static uint16_t tempo = 50;
+static bool     timeline = false;
+
+static uint64_t nanoseconds() {
+  struct timespec now;
+  clock_gettime(CLOCK_MONOTONIC, &now);
+  return (uint64_t)now.tv_sec * 1000000000 + now.tv_nsec;
+}
+
+static void print_time(uint32_t ticks) {
+  printf("%u:%05.2f", ticks / tempo / 60, (ticks % (60 * tempo)) / (float)tempo);
+}
+
+static void row_played(uint8_t order, uint8_t row, uint32_t tick) {
+  printf("%5u %3u %7u ", order, row, tick);
+  print_time(tick);
+  printf("\n");
+}
+
+static void print_use(char **argv) {
+  printf("Usage:\n\t%s [options] [input]\n", argv[0]);
+  printf("[input] is a .sqm file, or a source file containing a Melody array\n");
+  printf("Options:\n");
+  printf("\t-T [tempo]   tempo, as Squawk.tempo() (default 50)\n");
+  printf("\t-t           list order, row, tick and time of every row played\n");
+  printf("Example\n\t%s -t melody.sqm\n", argv[0]);
+}
+
+int main(int argc, char **argv) {
+  squawk_scan_t info;
+  uint8_t *melody;
+  uint64_t start;
+  size_t size;
+  int opt;
+
+  while((opt = getopt(argc, argv, "T:t")) != -1) {
+    switch(opt) {
+      case 'T': tempo    = atoi(optarg); break;
+      case 't': timeline = true;         break;
+      default:  print_use(argv); return 1;
+    }
+  }
+  if(argc - optind != 1 || tempo == 0) {
+    print_use(argv);
+    return 1;
+  }
+
+  melody = load_melody(argv[optind], &size);
+  if(!melody || size == 0) {
+    fprintf(stderr, "Unable to open input file\n");
+    return 1;
+  }
+
+  Squawk.begin(32000);
+  Squawk.play(melody);
+  Squawk.tempo(tempo);
+  if(timeline) printf("order row    tick time\n");
+  start = nanoseconds();
+  info = Squawk.scan(timeline ? row_played : NULL);
+  start = nanoseconds() - start;
+
+  printf("Length:     %u ticks, ", info.ticks);
+  print_time(info.ticks);
+  printf("\nLoops to:   order %u row %u, tick %u, ", info.loop_order, info.loop_row, info.loop_tick);
+  print_time(info.loop_tick);
+  printf("\nScanned in: %.3f ms\n", start / 1e6);
+
+  free(melody);
+  return 0;
+}
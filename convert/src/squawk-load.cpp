@@ -0,0 +1,61 @@
+// Melody loader shared by the Squawk PC tools
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <ctype.h>
+#include "squawk-load.h"
+
+// Either format, see squawk-load.h
+uint8_t *load_melody(const char *filename, size_t *size) {
+  uint8_t *data, *melody;
+  char *p_text, *p_brace = NULL;
+  size_t n = 0;
+  long length;
+  FILE *f;
+
+  f = fopen(filename, "rb");
+  if(!f) return NULL;
+  fseek(f, 0, SEEK_END);
+  length = ftell(f);
+  fseek(f, 0, SEEK_SET);
+  data = (uint8_t*)malloc(length + 1);
+  if(!data || fread(data, 1, length, f) != (size_t)length) {
+    fclose(f);
+    free(data);
+    return NULL;
+  }
+  fclose(f);
+
+  // Binary Squawk SD file
+  if(length >= 4 && memcmp(data, "SQM", 3) == 0) {
+    *size = length;
+    return data;
+  }
+
+  // Melody array, find its definition (not a declaration)
+  data[length] = 0;
+  for(p_text = strstr((char*)data, "Melody"); p_text; p_text = strstr(p_text + 1, "Melody")) {
+    p_brace = strchr(p_text, '{');
+    if(p_brace && p_brace < strchr(p_text, ';')) break;
+  }
+  p_text = p_text ? p_brace : strchr((char*)data, '{');
+
+  // Parse the numbers between the braces
+  melody = (uint8_t*)malloc(length);
+  if(!p_text || !melody) {
+    free(data);
+    free(melody);
+    return NULL;
+  }
+  for(p_text++; *p_text && *p_text != '}'; ) {
+    if(isdigit(*p_text)) {
+      melody[n++] = strtoul(p_text, &p_text, 0);
+    } else {
+      p_text++;
+    }
+  }
+  free(data);
+  *size = n;
+  return melody;
+}
@@ -0,0 +1,13 @@
+// Melody loader shared by the Squawk PC tools
+
+#ifndef _SQUAWK_LOAD_H_
+#define _SQUAWK_LOAD_H_
+#include <stddef.h>
+#include <stdint.h>
+
+// Loads a melody: either a .sqm file, or a text file (.c, .h, .ino...)
+// containing a Melody array as generated by mod2squawk -a - returns NULL
+// on failure, free() it when done
+uint8_t *load_melody(const char *filename, size_t *size);
+
+#endif
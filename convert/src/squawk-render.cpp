@@ -0,0 +1,156 @@
+// Squawk offline renderer
+//
+// Renders a Squawk melody to a WAV file (or raw 8-bit PCM) on a PC, using
+// the real playroutine from libraries/Squawk/Squawk.cpp and the portable
+// sample grinder from Squawk.h. Output is the exact byte sequence the chip
+// writes to its PWM register, with one difference: on the chip, samples
+// that interrupt a running playroutine see its half-finished updates, here
+// each playroutine tick completes between two samples.
+//
+// Build (from convert/src):
+//   g++ -O2 -I host -I ../../libraries/Squawk -I ../../libraries/SquawkSRAM
+//       -I ../../libraries/Fat16 -o squawk-render squawk-render.cpp
+//       squawk-load.cpp host/Arduino.cpp ../../libraries/Squawk/Squawk.cpp
+//       ../../libraries/SquawkSRAM/SquawkSRAM.cpp
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <unistd.h>
+#include "Squawk.h"
+#include "SquawkSRAM.h"
+#include "squawk-load.h"
+
+// Host sample grinder, writing to the emulated OCR2B
+SQUAWK_CONSTRUCT_ISR(SQUAWK_PWM_PIN3)
+
+static void put_le(FILE *f, uint32_t value, uint8_t bytes) {
+  while(bytes--) {
+    fputc(value & 0xFF, f);
+    value >>= 8;
+  }
+}
+
+static void write_wav_header(FILE *f, uint16_t rate, uint32_t samples) {
+  fwrite("RIFF", 1, 4, f);
+  put_le(f, 36 + samples, 4);
+  fwrite("WAVEfmt ", 1, 8, f);
+  put_le(f, 16, 4);      // fmt chunk size
+  put_le(f, 1, 2);       // PCM
+  put_le(f, 1, 2);       // mono
+  put_le(f, rate, 4);    // sample rate
+  put_le(f, rate, 4);    // byte rate
+  put_le(f, 1, 2);       // block align
+  put_le(f, 8, 2);       // 8 bits, unsigned - same as the PWM register
+  fwrite("data", 1, 4, f);
+  put_le(f, samples, 4);
+}
+
+static void print_use(char **argv) {
+  printf("Usage:\n\t%s [options] [input] [output]\n", argv[0]);
+  printf("[input] is a .sqm file, or a source file containing a Melody array\n");
+  printf("[output] is a .wav file, or - for standard output\n");
+  printf("Options:\n");
+  printf("\t-r [hz]      sample rate (default 32000)\n");
+  printf("\t-t [tuning]  tuning, as Squawk.tune() (default 1.0)\n");
+  printf("\t-T [tempo]   tempo, as Squawk.tempo() (default 50)\n");
+  printf("\t-l [seconds] length to render (default 60)\n");
+  printf("\t-p           write raw 8-bit unsigned PCM instead of WAV\n");
+  printf("\t-q           prefetch rows with Squawk.service(), as SD players do\n");
+  printf("\t-b           render blocks with squawk_render(), as SQUAWK_CONSTRUCT_BUFFERED_ISR\n");
+  printf("\t-s           play from a stand-in SPI SRAM, as SquawkSRAM does (implies -q)\n");
+  printf("Example\n\t%s -r 44100 melody.sqm melody.wav\n", argv[0]);
+}
+
+int main(int argc, char **argv) {
+  uint16_t rate = 32000, tempo = 50;
+  float tuning = 1.0, seconds = 60.0;
+  bool raw = false, prefetch = false, blocks = false, sram = false;
+  uint8_t *melody, *buffer;
+  uint32_t n, samples;
+  size_t size;
+  FILE *f;
+  int opt;
+
+  while((opt = getopt(argc, argv, "r:t:T:l:pqbs")) != -1) {
+    switch(opt) {
+      case 'r': rate     = atoi(optarg); break;
+      case 't': tuning   = atof(optarg); break;
+      case 'T': tempo    = atoi(optarg); break;
+      case 'l': seconds  = atof(optarg); break;
+      case 'p': raw      = true;         break;
+      case 'q': prefetch = true;         break;
+      case 'b': blocks   = true;         break;
+      case 's': sram     = prefetch = true; break;
+      default:  print_use(argv); return 1;
+    }
+  }
+  if(argc - optind != 2 || rate == 0 || tempo == 0) {
+    print_use(argv);
+    return 1;
+  }
+
+  melody = load_melody(argv[optind], &size);
+  if(!melody || size == 0) {
+    fprintf(stderr, "Unable to open input file\n");
+    return 1;
+  }
+
+  if(sram && size > sizeof(squawk_host_spiram)) {
+    fprintf(stderr, "Melody doesn't fit in SPI SRAM\n");
+    free(melody);
+    return 1;
+  }
+
+  if(strcmp(argv[optind + 1], "-") == 0) {
+    f = stdout;
+  } else {
+    f = fopen(argv[optind + 1], "wb");
+  }
+  if(!f) {
+    fprintf(stderr, "Unable to open output file\n");
+    free(melody);
+    return 1;
+  }
+
+  // Same sequence as a sketch would use
+  Squawk.begin(rate);
+  if(sram) {
+    SquawkSRAM.write(squawk_host_spiram_cs, 0, melody, size);
+    SquawkSRAM.play(squawk_host_spiram_cs, 0);
+  } else {
+    Squawk.play(melody);
+  }
+  Squawk.tune(tuning);
+  Squawk.tempo(tempo);
+
+  samples = (uint32_t)(seconds * rate);
+  buffer = (uint8_t*)malloc(samples);
+  if(!buffer) {
+    fprintf(stderr, "Out of memory\n");
+    free(melody);
+    return 1;
+  }
+  for(n = 0; n < samples; ) {
+    if(prefetch) Squawk.service();
+    // Timer1 compare interrupt enabled?
+    if(!(TIMSK1 & _BV(OCIE1A))) {
+      buffer[n++] = SQUAWK_PWM_PIN3;
+    } else if(blocks) {
+      // Same samples as the buffered grinder plays, without its latency
+      uint8_t count = samples - n < SQUAWK_BUFFER_SIZE / 2 ? samples - n : SQUAWK_BUFFER_SIZE / 2;
+      squawk_render(&buffer[n], count);
+      for(; count; count--, n++) buffer[n] ^= 0x80;
+    } else {
+      buffer[n++] = squawk_grind();
+    }
+  }
+  if(prefetch) fprintf(stderr, "Row underruns: %u\n", Squawk.rowUnderruns());
+
+  if(!raw) write_wav_header(f, rate, samples);
+  fwrite(buffer, 1, samples, f);
+  if(f != stdout) fclose(f);
+  free(buffer);
+  free(melody);
+  return 0;
+}
@@ -9,12 +9,33 @@
 #define PERIOD_MIN 28
 #define PERIOD_MAX 3424
 
+// Sample rate range for SquawkSynth::beginAuto()
+#define SAMPLE_RATE_MIN 4000
+#define SAMPLE_RATE_MAX 44100
+
+// Rows prefetched by SquawkSynth::service()
+#ifndef SQUAWK_ROW_QUEUE
+#define SQUAWK_ROW_QUEUE 2
+#endif
+
+// Sound effects waiting for their channel, see SquawkSynth::sfx()
+#ifndef SQUAWK_SFX_QUEUE
+#define SQUAWK_SFX_QUEUE 4
+#endif
+
+// Stream position stream_read() can't rely on, after others used the stream
+#define STREAM_LOST ((size_t)-1)
+
 // Convenience macros
 #define LO4(V)    ((V) & 0x0F)
 #define HI4(V)    (((V) & 0xF0) >> 4)
 #define MIN(A, B) ((A) < (B) ? (A) : (B))
 #define MAX(A, B) ((A) > (B) ? (A) : (B))
-#define FREQ(PERIOD) (p_fxm->tune + tuning_long / (PERIOD))
+// Period math is done in 16 bits (as int is on AVR), also on host builds -
+// the period played is noted for the seek index
+#define FREQ(PERIOD) (p_fxm->tune + squawk_freq(p_fxm->pitch = (uint16_t)(PERIOD)))
+// Melody volume as latched, after the mute mask and master volume
+#define VOL(V) mix_vol(ch, melody_vol[ch] = (V))
 
 // SquawkStream class for PROGMEM data
 class StreamROM : public SquawkStream {
@@ -24,6 +45,19 @@ class StreamROM : public SquawkStream {
   public:
     StreamROM(const uint8_t *p_rom = NULL) { p_start = p_cursor = (uint8_t*)p_rom; }
     uint8_t read() { return pgm_read_byte(p_cursor++); }
+    void read(uint8_t *p_dst, uint8_t count) { while(count--) *p_dst++ = pgm_read_byte(p_cursor++); }
+    void seek(size_t offset) { p_cursor = p_start + offset; }
+};
+
+// SquawkStream class for data in RAM
+class StreamRAM : public SquawkStream {
+  private:
+    const uint8_t *p_start;
+    const uint8_t *p_cursor;
+  public:
+    StreamRAM(const uint8_t *p_ram = NULL) { p_start = p_cursor = p_ram; }
+    uint8_t read() { return *p_cursor++; }
+    void read(uint8_t *p_dst, uint8_t count) { memcpy(p_dst, p_cursor, count); p_cursor += count; }
     void seek(size_t offset) { p_cursor = p_start + offset; }
 };
 
@@ -37,8 +71,58 @@ typedef struct {
 // Deconstructed cell
 typedef struct {
   uint8_t fxc, fxp, ixp;
+  uint8_t flags;
 } cel_t;
 
+// Cell flags, worked out once per row so ticks need not decode effects
+#define CEL_NOTE      0x01 // Has a note (or a tone-portamento target)
+#define CEL_PORTA     0x02 // Tone-portamento (3xx, 5xy)
+#define CEL_VOLSLIDE  0x04 // Volume slide (5xy, 6xy, Axy)
+#define CEL_VIBRATO   0x08 // Vibrato (4xy, 6xy)
+#define CEL_TREMOLO   0x10 // Tremolo (7xy)
+#define CEL_ARPEGGIO  0x20 // Normal play or arpeggio (0xy)
+#define CEL_POSITION  0x40 // Changes position or speed (Bxx, Dxx, Fxx, EEx)
+#define CEL_TICK0     0x80 // Nothing to do after the first tick
+
+// Prefetched row
+typedef struct {
+  uint8_t order, row;
+  cel_t   cel[4];
+} row_t;
+
+// Sound effect playing on a channel
+typedef struct {
+  const uint8_t *p_step;               // Next step of its script
+  uint8_t   ticks;                     // Ticks left of the current step
+  uint8_t   priority;
+  int8_t    slide;
+  uint16_t  period;
+} sfx_t;
+
+// Sound effect waiting for its channel
+typedef struct {
+  const uint8_t *p_script;
+  uint8_t   channel;
+  uint8_t   priority;
+} sfx_wait_t;
+
+// Note envelope of a channel, see SquawkSynth::noteOn()
+typedef struct {
+  uint8_t   attack, decay, sustain, release; // Set by SquawkSynth::envelope()
+  uint8_t   stage;
+  uint8_t   ticks;                     // Ticks left of the stage, 0 holds
+  uint8_t   peak;                      // Volume the attack goes up to
+  uint8_t   target;                    // Volume at the end of the stage
+  uint16_t  level;                     // Volume, 8.8 fixed point
+  int16_t   step;                      // Added to level every tick
+} env_t;
+
+// Envelope stages
+#define ENV_ATTACK    0
+#define ENV_DECAY     1
+#define ENV_SUSTAIN   2
+#define ENV_RELEASE   3
+
 // Effect memory
 typedef struct {
   int8_t    volume;
@@ -48,8 +132,11 @@ typedef struct {
   pto_t     vibr;
   pto_t     trem;
   uint16_t  period;
+  uint16_t  pitch;                     // Period played, vibrato and arpeggio included
+  uint8_t   note;
   uint8_t   param;
   int8_t    tune;
+  uint8_t   table;                     // 8xx, noted without SQUAWK_TABLES too
 } fxm_t;
 
 // Locals
@@ -62,24 +149,143 @@ static uint8_t  ix_order;
 static uint8_t  ix_nextrow;
 static uint8_t  ix_nextorder;
 static uint8_t  row_delay;
+static uint8_t  tick_busy;     // Channels left to process this tick
+static bool     tick_jump;     // Pattern jump seen this tick
+#ifdef SQUAWK_SPREAD_TICKS
+static bool     spread_tick;   // Tick under way, more channels to go
+static uint16_t spread_samples; // Samples since the tick started
+#endif
 static fxm_t    fxm[4];
 static cel_t    cel[4];
 static uint32_t tuning_long;
+static uint16_t recip_tbl[65];
+static int8_t   recip_shift;
 static uint16_t sample_rate;
 static float    tuning = 1.0;
 static uint16_t tick_rate = 50;
 
 static SquawkStream *stream;
+static size_t   stream_cursor;         // Stream position, STREAM_LOST if unknown
 static uint16_t stream_base;
+static uint16_t index_base;            // Seek index in stream, 0 if none
 static StreamROM rom;
+static StreamRAM ram;
+
+// Row prefetch queue, filled by service() and emptied by the playroutine
+static row_t    row_queue[SQUAWK_ROW_QUEUE];
+static volatile uint8_t rq_head;
+static volatile uint8_t rq_count;
+static uint8_t  rq_order;              // Position to prefetch next
+static uint8_t  rq_row;
+static volatile bool    rq_resync;     // Playroutine changed position above
+static volatile bool    rq_busy;       // service() is using the stream
+static bool     rq_serviced;           // service() has run since play()
+static bool     row_ready;
+static uint8_t  row_active;            // Channels with work after the first tick
+static uint16_t row_underruns;
+
+// Sound effects - the playroutine keeps playing the melody into sfx_osc on
+// the channels they have, for when they are done
+static volatile uint8_t sfx_active;    // Channels playing a sound effect
+static sfx_t    sfx_play[4];
+static osc_t    sfx_osc[4];
+static sfx_wait_t sfx_queue[SQUAWK_SFX_QUEUE];
+static uint8_t  sfx_queued;
+
+// Note envelopes, for sketches playing notes themselves - channels with
+// one under way get their volume from it every tick
+static volatile uint8_t env_active;
+// Default envelope: none, notes start and stop at once, at full volume
+#define ENV_NONE { 0, 0, 0xFF, 0, ENV_ATTACK, 0, 0, 0, 0, 0 }
+static env_t    env[4] = { ENV_NONE, ENV_NONE, ENV_NONE, ENV_NONE };
+
+// Mixer - muted channels and the master volume (and its fade) apply to the
+// melody where the playroutine sets its volume, the grinder never sees them
+static uint8_t  melody_vol[4];         // Melody volume, before the mixer
+static uint8_t  mix_mute;              // Muted channels
+static uint16_t mix_master = 0xFF00;   // Master volume, 8.8 while fading
+static int16_t  mix_step;              // Master volume change per tick
+static uint16_t mix_ticks;             // Ticks left to fade
+static uint8_t  mix_target;            // Master volume at the end of it
+
+// Returns the volume heard for a melody volume on a channel
+static inline uint8_t mix_vol(uint8_t ch, uint8_t vol) {
+  if(mix_mute & (1 << ch)) return 0;
+  return (vol * ((mix_master >> 8) + 1U)) >> 8;
+}
+
+// Returns the oscillator the melody plays a channel on
+static inline osc_t *music_osc(uint8_t ch) {
+  return (sfx_active & (1 << ch)) ? &sfx_osc[ch] : &osc[ch];
+}
+
+#ifdef SQUAWK_PCM
+// PCM voice - the grinder plays squawk_pcm_buffer, refilled from PROGMEM by
+// squawk_pcm_refill(), or from a stream by service()
+static const uint8_t *pcm_rom;
+static SquawkStream *pcm_stream;
+static size_t   pcm_offset;            // Stream position to read on from
+static uint16_t pcm_rate;              // Sample rate of the sample
+static uint32_t pcm_left;              // Samples left to read
+static uint8_t  pcm_format;
+static uint8_t  pcm_vol;
+static uint8_t  pcm_byte;              // Byte holding the next 4-bit sample
+static bool     pcm_nibble;            // Next 4-bit sample is in pcm_byte
+static uint8_t  pcm_next;              // Buffer half to refill next
+static uint8_t  pcm_silent;            // Halves refilled after the sample
+static volatile bool pcm_busy;         // Being refilled, or set up
+#endif
+
+#ifdef SQUAWK_TABLES
+// Wave tables the melody picks from with 8xx, see SquawkSynth::waveTables()
+static const int8_t * const *wave_tables;
+static uint8_t  wave_count;
+#endif
+
+// Shared 16-bit xorshift LFSR for the random vibrato/tremolo waveform,
+// seeded by begin() so every run plays the same sequence
+static uint16_t pto_lfsr;
+#define PTO_LFSR_SEED 0xACE1
+
+#ifdef SQUAWK_STATS
+// Counters behind SquawkSynth::stats()
+static struct {
+  uint32_t samples;
+  uint32_t ticks;
+  uint32_t tick_cycles;
+  uint16_t tick_max;
+  uint16_t dropped;
+} stats_data;
+#endif
 
 // Imports
 extern intptr_t squawk_register;
 extern uint16_t cia;
+extern uint16_t cia_count;
+extern uint8_t  squawk_channels;
+extern uint8_t  squawk_noise;
+#ifdef SQUAWK_TABLES
+extern const int8_t * const squawk_table_init[4];
+#endif
+#ifdef SQUAWK_HOST
+extern uint8_t  squawk_grind();
+#else
+extern "C" void TIMER1_COMPA_vect(void);
+#endif
+#ifdef SQUAWK_STATS
+extern uint8_t  squawk_grind_cycles;
+#endif
 
 // Exports
 osc_t osc[4];
 uint8_t pcm __attribute__((used)) = 128;
+#ifdef SQUAWK_PCM
+uint8_t squawk_pcm_buffer[SQUAWK_PCM_BUFFER] __attribute__((used));
+uint8_t squawk_pcm_ix __attribute__((used));
+uint8_t squawk_pcm_phase __attribute__((used));
+uint8_t squawk_pcm_step __attribute__((used));
+#endif
+uint16_t squawk_buffer_underruns;
 
 // ProTracker period tables
 const uint16_t period_tbl[84] PROGMEM = {
@@ -117,7 +323,10 @@ static int8_t do_osc(pto_t *p_osc) {
       sample = (p_osc->offset & 0x20) ? 127 : -128;
       break;
     case 3: // Noise (random)
-      sample = rand();
+      pto_lfsr ^= pto_lfsr << 7;
+      pto_lfsr ^= pto_lfsr >> 9;
+      pto_lfsr ^= pto_lfsr << 8;
+      sample = pto_lfsr;
       break;
   }
   mul = sample * LO4(p_osc->fxp);
@@ -125,39 +334,320 @@ static int8_t do_osc(pto_t *p_osc) {
   return mul >> 6;
 }
 
+#ifdef SQUAWK_TABLES
+// Hands a channel's oscillator the wave table its effect memory says
+static void wave_select(uint8_t ch) {
+  if(fxm[ch].table < wave_count) music_osc(ch)->table = wave_tables[fxm[ch].table];
+}
+#endif
+
+// Finds index of the first note with a period not above current period
+// (83 if there is none), starting from the last known index - which is set
+// when a note starts, so it only needs to move after a slide
+static inline uint8_t note_index(fxm_t *p_fxm) {
+  uint8_t n = p_fxm->note;
+  while(n < 83 && p_fxm->period < pgm_read_word(&period_tbl[n])) n++;
+  while(n != 0 && p_fxm->period >= pgm_read_word(&period_tbl[n - 1])) n--;
+  return p_fxm->note = n;
+}
+
 // Calculates and returns arpeggio period
 // Essentially finds period of current note + halftones
 static inline uint16_t arpeggio(uint8_t ch, uint8_t halftones) {
-  uint8_t n;
-  for(n = 0; n != 83; n++) {
-    if(fxm[ch].period >= pgm_read_word(&period_tbl[n])) break;
-  }
-  return pgm_read_word(&period_tbl[MIN(n + halftones, 47)]);
+  return pgm_read_word(&period_tbl[MIN(note_index(&fxm[ch]) + halftones, 47)]);
 }
 
 // Calculates and returns glissando period
 // Essentially snaps a sliding frequency to the closest note
 static inline uint16_t glissando(uint8_t ch) {
-  uint8_t n;
+  uint8_t n = note_index(&fxm[ch]);
   uint16_t period_h, period_l;
-  for(n = 0; n != 47; n++) {
-    period_l = pgm_read_word(&period_tbl[n]);
-    period_h = pgm_read_word(&period_tbl[n + 1]);
-    if(fxm[ch].period < period_l && fxm[ch].period >= period_h) {
-      if(period_l - fxm[ch].period <= fxm[ch].period - period_h) {
-        period_h = period_l;
-      }
-      break;
-    }
+  if(n == 0 || n > 47) return pgm_read_word(&period_tbl[47]);
+  period_l = pgm_read_word(&period_tbl[n - 1]);
+  period_h = pgm_read_word(&period_tbl[n]);
+  if(period_l - fxm[ch].period <= fxm[ch].period - period_h) {
+    period_h = period_l;
   }
   return period_h;
 }
 
+// Calculates tuning constant, and the reciprocal table used by squawk_freq()
+// recip_tbl[n] = (tuning_long << recip_shift) / (64 + n), scaled to 16 bits
+static void set_tuning() {
+  uint32_t scaled;
+  uint8_t n;
+  tuning_long = (long)(((float)3669213184.0 / (float)sample_rate) * tuning);
+  scaled = tuning_long;
+  recip_shift = 0;
+  while(scaled >= (64UL << 16)) { scaled >>= 1; recip_shift--; }
+  while(scaled && scaled < (32UL << 16)) { scaled <<= 1; recip_shift++; }
+  for(n = 0; n != 65; n++) recip_tbl[n] = scaled / (64 + n);
+}
+
+// Converts period to oscillator frequency, tuning_long / period, without
+// dividing: the period is normalized to 64..127 and looked up, with linear
+// interpolation of the bits shifted out. Within one LSB of the division,
+// checked by convert/src/squawk-check. Period 0 gives all ones, as division on AVR.
+uint16_t squawk_freq(uint16_t period) {
+  uint8_t s = 0;
+  int8_t shift = recip_shift;
+  uint16_t freq, frac;
+  if(period < 64) {
+    if(!period) return 0xFFFF;
+    do { period <<= 1; shift--; } while(period < 64);
+    freq = recip_tbl[period - 64];
+  } else {
+    for(frac = period; frac >= 128; frac >>= 1) s++;
+    frac = period & ((1 << s) - 1);
+    period >>= s;
+    freq = recip_tbl[period - 64];
+    if(frac) freq -= ((uint32_t)(freq - recip_tbl[period - 63]) * frac) >> s;
+    shift += s;
+  }
+  if(shift < 0) return freq << -shift;
+  return shift < 16 ? freq >> shift : 0;
+}
+
+#ifdef SQUAWK_PCM
+// Returns the PCM voice's sample, stepping it on as the grinder does
+static inline uint8_t pcm_sample() {
+  squawk_pcm_phase += squawk_pcm_step;
+  if(squawk_pcm_phase < squawk_pcm_step) {
+    squawk_pcm_ix = (squawk_pcm_ix + 1) & (SQUAWK_PCM_BUFFER - 1);
+    if(!(squawk_pcm_ix & (SQUAWK_PCM_BUFFER / 2 - 1))) squawk_pcm_refill();
+  }
+  return squawk_pcm_buffer[squawk_pcm_ix];
+}
+#endif
+
+// Renders samples for SQUAWK_CONSTRUCT_BUFFERED_ISR, the same as the sample
+// grinder would, but with oscillators kept in registers between ticks
+void squawk_render(uint8_t *p_buffer, uint8_t count) {
+  while(count) {
+    uint16_t phase0 = osc[0].phase, freq0 = osc[0].freq;
+    uint16_t phase1 = osc[1].phase, freq1 = osc[1].freq;
+    uint16_t phase2 = osc[2].phase, freq2 = osc[2].freq;
+    uint16_t lfsr   = osc[3].freq;
+    uint8_t  vol0 = osc[0].vol, vol1 = osc[1].vol, vol2 = osc[2].vol, vol3 = osc[3].vol;
+    uint8_t  n = count;
+
+    // Up to the next tick (cia_count 0 counts as 65536, as in the grinder)
+    if(cia_count && cia_count < n) n = cia_count;
+    count -= n;
+    cia_count -= n;
+    do {
+      uint8_t hi, sample;
+      phase2 += freq2;
+      hi = phase2 >> 8;
+      hi = ((hi & 0x80) ? ~hi : hi) << 1;
+      hi -= 128;
+      sample = (uint8_t)(((int8_t)hi * (int8_t)vol2) >> 8) << 1;
+      phase0 += freq0;
+      hi = phase0 >> 8;
+      sample += (hi & (hi << 1) & 0x80) ? -vol0 : vol0;
+      phase1 += freq1;
+      sample += (phase1 & 0x8000) ? -vol1 : vol1;
+      lfsr <<= 1;
+      if(lfsr & 0x8000) lfsr ^= 1;
+      if(lfsr & 0x4000) lfsr ^= 1;
+      sample += (lfsr & 0x8000) ? -vol3 : vol3;
+#ifdef SQUAWK_PCM
+      *p_buffer++ = sample + pcm_sample() - 128;
+#else
+      *p_buffer++ = sample + pcm - 128;
+#endif
+    } while(--n);
+    osc[0].phase = phase0;
+    osc[1].phase = phase1;
+    osc[2].phase = phase2;
+    osc[3].freq  = lfsr;
+
+    if(!cia_count) {
+      cia_count = cia;
+      squawk_playroutine();
+    }
+  }
+}
+
+#ifdef SQUAWK_TABLES
+// Sets the wave tables the melody picks from
+void SquawkSynth::waveTables(const int8_t * const *tables, uint8_t count) {
+  uint8_t ch;
+  cli();
+  wave_tables = tables;
+  wave_count  = count;
+  for(ch = 0; ch != 4; ch++) wave_select(ch);
+  sei();
+}
+#endif
+
+// Returns number of buffered sample underruns
+uint16_t SquawkSynth::sampleUnderruns() {
+  uint16_t count;
+  cli();
+  count = squawk_buffer_underruns;
+  sei();
+  return count;
+}
+
+#ifdef SQUAWK_PCM
+// Reads the PCM voice's next sample, around pcm at its volume - or pcm,
+// once the sample is over
+static uint8_t pcm_read() {
+  int8_t data;
+  if(!pcm_left) return pcm;
+  pcm_left--;
+  if(pcm_nibble) {
+    data = pcm_byte << 4;
+    pcm_nibble = false;
+  } else {
+    pcm_byte = pcm_rom ? pgm_read_byte(pcm_rom++) : pcm_stream->read();
+    pcm_offset++;
+    data = pcm_byte;
+    if(pcm_format == SQUAWK_PCM_4BIT) {
+      data = pcm_byte & 0xF0;
+      pcm_nibble = true;
+    }
+  }
+  return pcm + ((data * pcm_vol) >> 7);
+}
+
+// Refills the buffer half the grinder left since the last refill, if any
+static void pcm_fill() {
+  uint8_t *p_buffer = &squawk_pcm_buffer[pcm_next];
+  uint8_t n;
+  if((squawk_pcm_ix & (SQUAWK_PCM_BUFFER / 2)) == pcm_next) return;
+  // Both halves silent once the sample is over, stop stepping through them
+  if(!pcm_left && pcm_silent < 2 && ++pcm_silent == 2) squawk_pcm_step = 0;
+  if(pcm_left && pcm_stream) {
+    // Possibly the melody's stream too
+    stream_cursor = STREAM_LOST;
+    pcm_stream->seek(pcm_offset);
+  }
+  for(n = SQUAWK_PCM_BUFFER / 2; n; n--) *p_buffer++ = pcm_read();
+  pcm_next ^= SQUAWK_PCM_BUFFER / 2;
+}
+
+// Refills the PCM voice from PROGMEM, called by the grinder when it steps
+// into the other buffer half, and by the playroutine
+__attribute__((used)) void squawk_pcm_refill() {
+  cli();
+  if(pcm_busy || !pcm_rom) {
+    sei();
+    return;
+  }
+  pcm_busy = true;
+  sei();
+  pcm_fill();
+  pcm_busy = false;
+}
+
+// Returns the PCM voice's step per sample, for its rate at sample_rate
+static uint8_t pcm_step() {
+  return MIN(((uint32_t)pcm_rate << 8) / sample_rate, 0xFF);
+}
+
+// Sets up the PCM voice and fills its buffer, then starts it
+static void pcm_start(const uint8_t *p_rom, SquawkStream *p_stream, size_t offset, uint32_t length, uint16_t rate, uint8_t vol, uint8_t format) {
+  cli();
+  squawk_pcm_step = 0;
+  pcm_busy = true;
+  sei();
+  pcm_rom    = p_rom;
+  pcm_stream = p_stream;
+  pcm_offset = offset;
+  pcm_left   = length;
+  pcm_rate   = rate;
+  pcm_format = format;
+  pcm_vol    = MIN(vol, 0x80);
+  pcm_nibble = false;
+  pcm_silent = 0;
+  // Both halves, as if the grinder had played them, from the first on
+  if(pcm_stream) rq_busy = true;
+  squawk_pcm_ix = SQUAWK_PCM_BUFFER / 2;
+  pcm_next = 0;
+  pcm_fill();
+  squawk_pcm_ix = 0;
+  pcm_fill();
+  if(pcm_stream) rq_busy = false;
+  cli();
+  squawk_pcm_phase = 0;
+  squawk_pcm_step  = pcm_silent < 2 ? pcm_step() : 0;
+  pcm_busy = false;
+  sei();
+}
+
+// Plays a PCM sample from PROGMEM
+void SquawkSynth::pcmPlay(const uint8_t *data, uint32_t length, uint16_t rate, uint8_t vol, uint8_t format) {
+  pcm_start(data, NULL, 0, length, rate, vol, format);
+}
+
+// Plays a PCM sample from a stream, read by service()
+void SquawkSynth::pcmPlay(SquawkStream *data, size_t offset, uint32_t length, uint16_t rate, uint8_t vol, uint8_t format) {
+  pcm_start(NULL, data, offset, length, rate, vol, format);
+}
+
+// Stops the PCM voice
+void SquawkSynth::pcmStop() {
+  cli();
+  squawk_pcm_step = 0;
+  pcm_rom    = NULL;
+  pcm_stream = NULL;
+  pcm_left   = 0;
+  sei();
+  memset(squawk_pcm_buffer, pcm, SQUAWK_PCM_BUFFER);
+}
+
+// Returns true while the PCM voice plays
+bool SquawkSynth::pcmPlaying() {
+  return squawk_pcm_step != 0;
+}
+#endif
+
+#ifdef SQUAWK_STATS
+// Returns playback statistics since begin()
+squawk_stats_t SquawkSynth::stats() {
+  squawk_stats_t result;
+  float total, busy;
+  cli();
+  result.samples  = stats_data.samples;
+  result.ticks    = stats_data.ticks;
+  result.dropped  = stats_data.dropped;
+  result.tick_max = stats_data.tick_max;
+  result.tick_avg = stats_data.ticks ? stats_data.tick_cycles / stats_data.ticks : 0;
+  busy = stats_data.tick_cycles;
+  sei();
+  // Every sample costs the grinder's cycles, out of a Timer1 period each
+  total = (float)result.samples * (OCR1A + 1);
+  busy += (float)result.samples * squawk_grind_cycles;
+  result.cpu = total ? (uint8_t)MIN(100.0 * busy / total, 100.0) : 0;
+  return result;
+}
+#endif
+
+// Seeds the LFSR of every noise channel that is at 0, where it stays silent
+static void seed_noise() {
+  uint8_t ch;
+  for(ch = 0; ch != 4; ch++) {
+    if((squawk_noise & (1 << ch)) && !osc[ch].freq) osc[ch].freq = 0x0001;
+  }
+}
+
+#ifdef SQUAWK_TABLES
+// Gives every oscillator without a wave table the default one, which TABLE
+// and TABLE_RAM channels play until the melody or the sketch picks another
+static void seed_tables() {
+  uint8_t ch;
+  for(ch = 0; ch != 4; ch++) {
+    if(!osc[ch].table) osc[ch].table = (const int8_t *)pgm_read_ptr(&squawk_table_init[ch]);
+  }
+}
+#endif
+
 // Tunes Squawk to a different frequency
 void SquawkSynth::tune(float new_tuning) {
   tuning = new_tuning;
-  tuning_long = (long)(((double)3669213184.0 / (double)sample_rate) * (double)tuning);
-
+  set_tuning();
 }
 
 // Sets tempo
@@ -168,18 +658,30 @@ void SquawkSynth::tempo(uint16_t new_tempo) {
 
 void SquawkSynth::beginEx(uint16_t hz) {
   sample_rate = hz;
-  tuning_long = (long)(((double)3669213184.0 / (double)sample_rate) * (double)tuning);
+  pto_lfsr = PTO_LFSR_SEED;
+  set_tuning();
   cia = sample_rate / tick_rate;
-  osc[3].freq = 0x0001;
+  seed_noise();
+#ifdef SQUAWK_TABLES
+  seed_tables();
+#endif
+#ifdef SQUAWK_PCM
+  pcmStop();
+#endif
 }
 
-// Initializes Squawk
-// Sets up the selected port, and the sample grinding ISR
-void SquawkSynth::begin(uint16_t hz) {
+// Sets up the sample rate, the selected port, and the sample grinding ISR -
+// begin() without stopping the PCM voice
+static void begin_rate(uint16_t hz) {
   word isr_rr;
 
+#ifdef SQUAWK_STATS
+  memset(&stats_data, 0, sizeof(stats_data));
+#endif
+
   sample_rate = hz;
-  tuning_long = (long)(((double)3669213184.0 / (double)sample_rate) * (double)tuning);
+  pto_lfsr = PTO_LFSR_SEED;
+  set_tuning();
   cia = sample_rate / tick_rate;
 
   if(squawk_register == (intptr_t)&OCR0A) {
@@ -276,8 +778,11 @@ void SquawkSynth::begin(uint16_t hz) {
 #endif
   }
 
-  // Seed LFSR
-  osc[3].freq = 0x0001;
+  // Seed LFSRs, and wave tables
+  seed_noise();
+#ifdef SQUAWK_TABLES
+  seed_tables();
+#endif
 
   // Set up ISR to run at sample_rate (may not be exact)
   isr_rr = F_CPU / sample_rate;
@@ -287,53 +792,170 @@ void SquawkSynth::begin(uint16_t hz) {
   OCR1AL = isr_rr & 0xFF;
 }
 
-// Decrunches a 9 byte row into a useful data
-static void decrunch_row() {
-  uint8_t data;
+// Initializes Squawk
+// Sets up the selected port, and the sample grinding ISR
+void SquawkSynth::begin(uint16_t hz) {
+#ifdef SQUAWK_PCM
+  pcmStop();
+#endif
+  begin_rate(hz);
+}
+
+// Returns the flags for a decrunched cell
+static uint8_t cel_flags(const cel_t *p_cel) {
+  uint8_t flags = 0;
+  if((p_cel->ixp & 0x7F) != 0x7F) flags |= CEL_NOTE;
+  switch(p_cel->fxc) {
+    case 0x00: flags |= CEL_ARPEGGIO | (p_cel->fxp ? 0 : CEL_TICK0); break;
+    case 0x30: flags |= CEL_PORTA;                   break;
+    case 0x40: flags |= CEL_VIBRATO;                 break;
+    case 0x50: flags |= CEL_PORTA | CEL_VOLSLIDE;    break;
+    case 0x60: flags |= CEL_VIBRATO | CEL_VOLSLIDE;  break;
+    case 0x70: flags |= CEL_TREMOLO;                 break;
+    case 0xA0: flags |= CEL_VOLSLIDE;                break;
+    case 0xB0:
+    case 0xD0:
+    case 0xF0:
+    case 0xEE: flags |= CEL_POSITION | CEL_TICK0;    break;
+    case 0x10: // Slides and note cut act on later ticks,
+    case 0x20: // note delay starts the note on one
+    case 0xEC:
+    case 0xED:                                       break;
+    default:   flags |= CEL_TICK0;                   break;
+  }
+  return flags;
+}
+
+// Reads count bytes at offset in the stream - melodies in PROGMEM (the
+// usual case) and RAM without going through virtual calls. Other streams
+// only seek when not there already, as rows mostly follow each other
+static inline void stream_read(size_t offset, uint8_t *p_dst, uint8_t count) {
+  if(stream == &rom) {
+    rom.StreamROM::seek(offset);
+    rom.StreamROM::read(p_dst, count);
+  } else if(stream == &ram) {
+    ram.StreamRAM::seek(offset);
+    ram.StreamRAM::read(p_dst, count);
+  } else {
+    if(offset != stream_cursor) stream->seek(offset);
+    stream->read(p_dst, count);
+    stream_cursor = offset + count;
+  }
+}
+
+// Reads a 9 byte row from the stream, and decrunches it into useful data
+static void fetch_row(uint8_t ix_ord, uint8_t ix_r, cel_t *p_cel) {
+  uint8_t data[9];
 
   // Initial decrunch
-  stream->seek(stream_base + ((order[ix_order] << 6) + ix_row) * 9);
-  data = stream->read(); cel[0].fxc  =  data << 0x04;
-                         cel[1].fxc  =  data &  0xF0;
-  data = stream->read(); cel[0].fxp  =  data;
-  data = stream->read(); cel[1].fxp  =  data;
-  data = stream->read(); cel[2].fxc  =  data << 0x04;
-                         cel[3].fxc  =  data >> 0x04;
-  data = stream->read(); cel[2].fxp  =  data;
-  data = stream->read(); cel[3].fxp  =  data;
-  data = stream->read(); cel[0].ixp  =  data;
-  data = stream->read(); cel[1].ixp  =  data;
-  data = stream->read(); cel[2].ixp  =  data;
+  stream_read(stream_base + ((order[ix_ord] << 6) + ix_r) * 9, data, 9);
+  p_cel[0].fxc  =  data[0] << 0x04;
+  p_cel[1].fxc  =  data[0] &  0xF0;
+  p_cel[0].fxp  =  data[1];
+  p_cel[1].fxp  =  data[2];
+  p_cel[2].fxc  =  data[3] << 0x04;
+  p_cel[3].fxc  =  data[3] >> 0x04;
+  p_cel[2].fxp  =  data[4];
+  p_cel[3].fxp  =  data[5];
+  p_cel[0].ixp  =  data[6];
+  p_cel[1].ixp  =  data[7];
+  p_cel[2].ixp  =  data[8];
 
   // Decrunch extended effects
-  if(cel[0].fxc == 0xE0) { cel[0].fxc |= cel[0].fxp >> 4; cel[0].fxp &= 0x0F; }
-  if(cel[1].fxc == 0xE0) { cel[1].fxc |= cel[1].fxp >> 4; cel[1].fxp &= 0x0F; }
-  if(cel[2].fxc == 0xE0) { cel[2].fxc |= cel[2].fxp >> 4; cel[2].fxp &= 0x0F; }
+  if(p_cel[0].fxc == 0xE0) { p_cel[0].fxc |= p_cel[0].fxp >> 4; p_cel[0].fxp &= 0x0F; }
+  if(p_cel[1].fxc == 0xE0) { p_cel[1].fxc |= p_cel[1].fxp >> 4; p_cel[1].fxp &= 0x0F; }
+  if(p_cel[2].fxc == 0xE0) { p_cel[2].fxc |= p_cel[2].fxp >> 4; p_cel[2].fxp &= 0x0F; }
 
   // Decrunch cell 3 ghetto-style
-  cel[3].ixp = ((cel[3].fxp & 0x80) ? 0x00 : 0x7F) | ((cel[3].fxp & 0x40) ? 0x80 : 0x00);
-  cel[3].fxp &= 0x3F;
-  switch(cel[3].fxc) {
+  p_cel += 3;
+  p_cel->ixp = ((p_cel->fxp & 0x80) ? 0x00 : 0x7F) | ((p_cel->fxp & 0x40) ? 0x80 : 0x00);
+  p_cel->fxp &= 0x3F;
+  switch(p_cel->fxc) {
     case 0x02:
-    case 0x03: if(cel[3].fxc & 0x01) cel[3].fxp |= 0x40; cel[3].fxp = (cel[3].fxp >> 4) | (cel[3].fxp << 4); cel[3].fxc = 0x70; break;
-    case 0x01: if(cel[3].fxp & 0x08) cel[3].fxp = (cel[3].fxp & 0x07) << 4; cel[3].fxc = 0xA0; break;
-    case 0x04: cel[3].fxc = 0xC0; break;
-    case 0x05: cel[3].fxc = 0xB0; break;
-    case 0x06: cel[3].fxc = 0xD0; break;
-    case 0x07: cel[3].fxc = 0xF0; break;
-    case 0x08: cel[3].fxc = 0xE7; break;
-    case 0x09: cel[3].fxc = 0xE9; break;
-    case 0x0A: cel[3].fxc = (cel[3].fxp & 0x08) ? 0xEA : 0xEB; cel[3].fxp &= 0x07; break;
-    case 0x0B: cel[3].fxc = (cel[3].fxp & 0x10) ? 0xED : 0xEC; cel[3].fxp &= 0x0F; break;
-    case 0x0C: cel[3].fxc = 0xEE; break;
-  }
-
-  // Apply generic effect parameter memory
+    case 0x03: if(p_cel->fxc & 0x01) p_cel->fxp |= 0x40; p_cel->fxp = (p_cel->fxp >> 4) | (p_cel->fxp << 4); p_cel->fxc = 0x70; break;
+    case 0x01: if(p_cel->fxp & 0x08) p_cel->fxp = (p_cel->fxp & 0x07) << 4; p_cel->fxc = 0xA0; break;
+    case 0x04: p_cel->fxc = 0xC0; break;
+    case 0x05: p_cel->fxc = 0xB0; break;
+    case 0x06: p_cel->fxc = 0xD0; break;
+    case 0x07: p_cel->fxc = 0xF0; break;
+    case 0x08: p_cel->fxc = 0xE7; break;
+    case 0x09: p_cel->fxc = 0xE9; break;
+    case 0x0A: p_cel->fxc = (p_cel->fxp & 0x08) ? 0xEA : 0xEB; p_cel->fxp &= 0x07; break;
+    case 0x0B: p_cel->fxc = (p_cel->fxp & 0x10) ? 0xED : 0xEC; p_cel->fxp &= 0x0F; break;
+    case 0x0C: p_cel->fxc = 0xEE; break;
+  }
+
+  // Work out what the playroutine has to do with each cell
+  p_cel -= 3;
+  p_cel[0].flags = cel_flags(&p_cel[0]);
+  p_cel[1].flags = cel_flags(&p_cel[1]);
+  p_cel[2].flags = cel_flags(&p_cel[2]);
+  p_cel[3].flags = cel_flags(&p_cel[3]);
+}
+
+// Finds the position played after a row, as the playroutine will,
+// following pattern and row jumps (B and D effects)
+static void next_position(const cel_t *p_cel, uint8_t *p_order, uint8_t *p_row) {
+  uint8_t ch, next_order = 0xFF, next_row = 0xFF;
+  bool    pattern_jump = false;
+  for(ch = 0; ch != 4; ch++) {
+    if(p_cel->fxc == 0xB0) {
+      next_order = (p_cel->fxp >= order_count ? 0x00 : p_cel->fxp);
+      next_row = 0;
+      pattern_jump = true;
+    } else if(p_cel->fxc == 0xD0) {
+      if(!pattern_jump) next_order = ((*p_order + 1) >= order_count ? 0x00 : *p_order + 1);
+      pattern_jump = true;
+      next_row = (p_cel->fxp > 63 ? 0 : p_cel->fxp);
+    }
+    p_cel++;
+  }
+  if(++*p_row == 64) {
+    *p_row = 0;
+    if(++*p_order >= order_count) *p_order = 0;
+  }
+  if(next_order != 0xFF) *p_order = next_order;
+  if(next_row   != 0xFF) *p_row   = next_row;
+}
+
+// Loads the row at ix_order/ix_row into cel - from the prefetch queue when
+// service() has it ready, otherwise from the stream, inside the sample ISR
+// as without service(), unless service() is using the stream right now, or
+// the stream can't be read from the ISR while it runs: then it returns
+// false, try again next tick. Only counts the rows it had to read itself as
+// underruns once service() is in use
+static bool decrunch_row() {
   uint8_t ch;
   cel_t *p_cel = cel;
   fxm_t *p_fxm = fxm;
+
+  // Drop rows prefetched for other positions
+  while(rq_count && (row_queue[rq_head].order != ix_order || row_queue[rq_head].row != ix_row)) {
+    if(++rq_head == SQUAWK_ROW_QUEUE) rq_head = 0;
+    rq_count--;
+  }
+  if(rq_count) {
+    memcpy(cel, row_queue[rq_head].cel, sizeof(cel));
+    if(++rq_head == SQUAWK_ROW_QUEUE) rq_head = 0;
+    rq_count--;
+  } else {
+    if(rq_serviced) row_underruns++;
+    if(rq_busy) return false;
+    if((TIMSK1 & _BV(OCIE1A)) && !stream->readInISR()) return false;
+    fetch_row(ix_order, ix_row, cel);
+    // Prefetching carries on after this row
+    rq_order = ix_order;
+    rq_row   = ix_row;
+    next_position(cel, &rq_order, &rq_row);
+    rq_resync = true;
+  }
+
+  // Apply generic effect parameter memory, and find the channels that have
+  // anything to do after the first tick
+  row_active = 0;
   for(ch = 0; ch != 4; ch++) {
     uint8_t fx = p_cel->fxc;
+    if(!(p_cel->flags & CEL_TICK0)) row_active |= 1 << ch;
     if(fx == 0x10 || fx == 0x20 || fx == 0xE1 || fx == 0xE2 || fx == 0x50 || fx == 0x60 || fx == 0xA0) {
       if(p_cel->fxp) {
         p_fxm->param = p_cel->fxp;
@@ -343,19 +965,90 @@ static void decrunch_row() {
     }
     p_cel++; p_fxm++;
   }
+  row_active &= squawk_channels;
+  return true;
 }
 
-// Resets playback
-static void playroutine_reset() {
-  memset(fxm, 0, sizeof(fxm));
+// Prefetches upcoming rows into the queue, in the foreground
+void SquawkSynth::service() {
+  row_t   entry;
+  uint8_t ix;
+  rq_serviced = true;
+#ifdef SQUAWK_PCM
+  // PCM voice from a stream, which the playroutine leaves alone meanwhile
+  if(pcm_stream) {
+    rq_busy = true;
+    pcm_fill();
+    rq_busy = false;
+  }
+#endif
+  while(order_count) {
+    cli();
+    if(rq_count == SQUAWK_ROW_QUEUE) {
+      sei();
+      return;
+    }
+    rq_resync   = false;
+    entry.order = rq_order;
+    entry.row   = rq_row;
+    rq_busy     = true;
+    sei();
+    fetch_row(entry.order, entry.row, entry.cel);
+    cli();
+    rq_busy = false;
+    // Keep it, unless the playroutine moved on to another position meanwhile
+    if(!rq_resync) {
+      ix = rq_head + rq_count;
+      if(ix >= SQUAWK_ROW_QUEUE) ix -= SQUAWK_ROW_QUEUE;
+      row_queue[ix] = entry;
+      rq_count++;
+      next_position(entry.cel, &rq_order, &rq_row);
+    }
+    sei();
+  }
+}
+
+// Returns number of rows service() did not have ready in time
+uint16_t SquawkSynth::rowUnderruns() {
+  uint16_t count;
+  cli();
+  count = row_underruns;
+  sei();
+  return count;
+}
+
+// Moves playback to the first tick of a row
+static void playroutine_position(uint8_t ix_ord, uint8_t ix_r) {
   tick         = 0;
-  ix_row       = 0;
-  ix_order     = 0;
+  ix_row       = ix_r;
+  ix_order     = ix_ord;
   ix_nextrow   = 0xFF;
   ix_nextorder = 0xFF;
   row_delay    = 0;
+  rq_head      = 0;
+  rq_count     = 0;
+#ifdef SQUAWK_SPREAD_TICKS
+  spread_tick    = false;
+  spread_samples = 0;
+#endif
+  row_ready    = decrunch_row();
+}
+
+// Resets playback
+static void playroutine_reset() {
+  uint8_t ch;
+  memset(fxm, 0, sizeof(fxm));
+  for(ch = 0; ch != 4; ch++) {
+#ifdef SQUAWK_TABLES
+    wave_select(ch);
+#endif
+    // Silent until the first note, as after a seek
+    if(!(squawk_noise & (1 << ch))) music_osc(ch)->freq = 0;
+  }
   speed        = 6;
-  decrunch_row();
+  playroutine_position(0, 0);
+  row_underruns = 0;
+  rq_serviced   = false;
 }
 
 // Start grinding samples
@@ -365,26 +1058,41 @@ void SquawkSynth::play() {
 
 // Load a melody stream and start grinding samples
 void SquawkSynth::play(SquawkStream *melody) {
+  uint16_t offset, size, index_size = 0;
   uint8_t n;
   pause();
   stream = melody;
+  stream_cursor = STREAM_LOST;
   stream->seek(0);
   n = stream->read();
+  index_base = 0;
   if(n == 'S') {
     // Squawk SD file
     stream->seek(4);
     stream_base = stream->read() << 8;
     stream_base |= stream->read();
     stream_base += 6;
+    // Meta data chunks: tag, size (big endian), data
+    for(offset = 6; offset + 3 <= stream_base; offset += size + 3) {
+      stream->seek(offset);
+      n = stream->read();
+      size = stream->read() << 8;
+      size |= stream->read();
+      if(n == 'I') {
+        index_base = offset + 3;
+        index_size = size;
+      }
+    }
   } else {
     // Squawk ROM array
     stream_base = 1;
   }
   stream->seek(stream_base);
   order_count = stream->read();
+  if(index_size != order_count * SQUAWK_SNAPSHOT_SIZE) index_base = 0;
   if(order_count <= 64) {
     stream_base += order_count + 1;
-    for(n = 0; n < order_count; n++) order[n] = stream->read();
+    stream->read(order, order_count);
     playroutine_reset();
     play();
   } else {
@@ -399,6 +1107,13 @@ void SquawkSynth::play(const uint8_t *melody) {
   play(&rom);
 }
 
+// Load a melody in RAM and start grinding samples
+void SquawkSynth::playRAM(const uint8_t *melody) {
+  pause();
+  ram = StreamRAM(melody);
+  play(&ram);
+}
+
 // Pause playback
 void SquawkSynth::pause() {
   TIMSK1 = 0; // Disable interrupt
@@ -410,235 +1125,993 @@ void SquawkSynth::stop() {
   order_count = 0; // Unload melody
 }
 
-// Progress module by one tick
-__attribute__((used)) void squawk_playroutine() {
-  static bool lockout = false;
+// Starts a tick, returns false if it has no channels to process
+static inline bool playroutine_begin() {
 
-  if(!order_count) return;
-
-  // Protect from re-entry via ISR
-  cli();
-  if(lockout) {
-    sei();
-    return;
+  // Hold playback for a tick while service() keeps the stream busy
+  if(!row_ready) {
+    if(!(row_ready = decrunch_row())) return false;
   }
-  lockout = true;
-  sei();
 
   // Handle row delay
   if(row_delay) {
     if(tick == 0) row_delay--;
     // Advance tick
     if(++tick == speed) tick = 0;
-  } else {
+    return false;
+  }
 
-    // Quick pointer access
-    fxm_t *p_fxm = fxm;
-    osc_t *p_osc = osc;
-    cel_t *p_cel = cel;
+  // Channels to process - after the first tick, only those with work left
+  tick_busy = tick ? row_active : 0x0F;
+  tick_jump = false;
+  return true;
+}
 
-    // Temps
-    uint8_t ch, fx, fxp;
-    bool    pattern_jump = false;
-    uint8_t ix_period;
+// Processes one channel for the tick
+static inline void playroutine_channel(uint8_t ch) {
+  uint8_t bit = 1 << ch;
 
-    for(ch = 0; ch != 4; ch++) {
-      uint8_t       temp;
+  // Quick pointer access
+  fxm_t *p_fxm = &fxm[ch];
+  osc_t *p_osc = music_osc(ch);
+  cel_t *p_cel = &cel[ch];
 
-      // Local register copy
-      fx        = p_cel->fxc;
-      fxp       = p_cel->fxp;
-      ix_period = p_cel->ixp;
+  // Temps
+  uint8_t fx, fxp, flags, temp;
+  bool    pitched;
+  uint8_t ix_period;
 
-      // If first tick
-      if(tick == (fx == 0xED ? fxp : 0)) {
+  // Local register copy
+  fx        = p_cel->fxc;
+  fxp       = p_cel->fxp;
+  ix_period = p_cel->ixp;
+  flags     = p_cel->flags;
 
-        // Reset volume
-        if(ix_period & 0x80) p_osc->vol = p_fxm->volume = 0x20;
+  // Channels switched off in the sample grinder only keep their effects
+  // on playback position and speed
+  if(!(squawk_channels & bit) && !(flags & CEL_POSITION)) return;
 
-        if((ix_period & 0x7F) != 0x7F) {
+  // Noise channel frequency is its LFSR, not to be touched
+  pitched = !(squawk_noise & bit);
 
-          // Reset oscillators (unless continous flag set)
-          if((p_fxm->vibr.mode & 0x4) == 0x0) p_fxm->vibr.offset = 0;
-          if((p_fxm->trem.mode & 0x4) == 0x0) p_fxm->trem.offset = 0;
+  // If first tick
+  if(tick == (fx == 0xED ? fxp : 0)) {
 
-          // Cell has note
-          if(fx == 0x30 || fx == 0x50) {
+    // Reset volume
+    if(ix_period & 0x80) p_osc->vol = VOL(p_fxm->volume = 0x20);
 
-            // Tone-portamento effect setup
-            p_fxm->port_target = pgm_read_word(&period_tbl[ix_period & 0x7F]);
-          } else {
+    if(flags & CEL_NOTE) {
 
-            // Set required effect memory parameters
-            p_fxm->period = pgm_read_word(&period_tbl[ix_period & 0x7F]);
+      // Reset oscillators (unless continous flag set)
+      if((p_fxm->vibr.mode & 0x4) == 0x0) p_fxm->vibr.offset = 0;
+      if((p_fxm->trem.mode & 0x4) == 0x0) p_fxm->trem.offset = 0;
 
-            // Start note
-            if(ch != 3) p_osc->freq = FREQ(p_fxm->period);
+      // Cell has note
+      if(flags & CEL_PORTA) {
 
-          }
-        }
+        // Tone-portamento effect setup
+        p_fxm->port_target = pgm_read_word(&period_tbl[ix_period & 0x7F]);
+      } else {
 
-        // Effects processed when tick = 0
-        switch(fx) {
-          case 0x30: // Portamento
-            if(fxp) p_fxm->port_speed = fxp;
-            break;
-          case 0xB0: // Jump to pattern
-            ix_nextorder = (fxp >= order_count ? 0x00 : fxp);
-            ix_nextrow = 0;
-            pattern_jump = true;
-            break;
-          case 0xC0: // Set volume
-            p_osc->vol = p_fxm->volume = MIN(fxp, 0x20);
-            break;
-          case 0xD0: // Jump to row
-            if(!pattern_jump) ix_nextorder = ((ix_order + 1) >= order_count ? 0x00 : ix_order + 1);
-            pattern_jump = true;
-            ix_nextrow = (fxp > 63 ? 0 : fxp);
-            break;
-          case 0xF0: // Set speed, BPM(CIA) not supported
-            if(fxp <= 0x20) speed = fxp;
-            break;
-          case 0x40: // Vibrato
-            if(fxp) p_fxm->vibr.fxp = fxp;
-            break;
-          case 0x70: // Tremolo
-            if(fxp) p_fxm->trem.fxp = fxp;
-            break;
-          case 0xE1: // Fine slide up
-            if(ch != 3) {
-              p_fxm->period = MAX(p_fxm->period - fxp, PERIOD_MIN);
-              p_osc->freq = FREQ(p_fxm->period);
-            }
-            break;
-          case 0xE2: // Fine slide down
-            if(ch != 3) {
-              p_fxm->period = MIN(p_fxm->period + fxp, PERIOD_MAX);
-              p_osc->freq = FREQ(p_fxm->period);
-            }
-            break;
-          case 0xE3: // Glissando control
-            p_fxm->glissando = (fxp != 0);
-            break;
-          case 0xE4: // Set vibrato waveform
-            p_fxm->vibr.mode = fxp;
-            break;
-          case 0xE5: // Set fine tune
-            p_fxm->tune = (fxp & 0x8) ? fxp - 0x10 : fxp;
-            break;
-          case 0xE7: // Set tremolo waveform
-            p_fxm->trem.mode = fxp;
-            break;
-          case 0xEA: // Fine volume slide up
-            p_osc->vol = p_fxm->volume = MIN(p_fxm->volume + fxp, 0x20);
-            break;
-          case 0xEB: // Fine volume slide down
-            p_osc->vol = p_fxm->volume = MAX(p_fxm->volume - fxp, 0);
-            break;
-          case 0xEE: // Delay
-            row_delay = fxp;
-            break;
+        // Set required effect memory parameters
+        p_fxm->period = pgm_read_word(&period_tbl[ix_period & 0x7F]);
+        p_fxm->note   = ix_period & 0x7F;
+
+        // Start note
+        if(pitched) p_osc->freq = FREQ(p_fxm->period);
+
+      }
+    }
+
+    // Effects processed when tick = 0
+    switch(fx) {
+      case 0x30: // Portamento
+        if(fxp) p_fxm->port_speed = fxp;
+        break;
+      case 0xB0: // Jump to pattern
+        ix_nextorder = (fxp >= order_count ? 0x00 : fxp);
+        ix_nextrow = 0;
+        tick_jump = true;
+        break;
+      case 0xC0: // Set volume
+        p_osc->vol = VOL(p_fxm->volume = MIN(fxp, 0x20));
+        break;
+      case 0xD0: // Jump to row
+        if(!tick_jump) ix_nextorder = ((ix_order + 1) >= order_count ? 0x00 : ix_order + 1);
+        tick_jump = true;
+        ix_nextrow = (fxp > 63 ? 0 : fxp);
+        break;
+      case 0xF0: // Set speed, BPM(CIA) not supported
+        if(fxp <= 0x20) speed = fxp;
+        break;
+      case 0x40: // Vibrato
+        if(fxp) p_fxm->vibr.fxp = fxp;
+        break;
+      case 0x70: // Tremolo
+        if(fxp) p_fxm->trem.fxp = fxp;
+        break;
+      case 0x80: // Set wave table (panning in ProTracker)
+        p_fxm->table = fxp;
+#ifdef SQUAWK_TABLES
+        wave_select(ch);
+#endif
+        break;
+      case 0xE1: // Fine slide up
+        if(pitched) {
+          p_fxm->period = MAX((uint16_t)(p_fxm->period - fxp), PERIOD_MIN);
+          p_osc->freq = FREQ(p_fxm->period);
         }
-      } else {
+        break;
+      case 0xE2: // Fine slide down
+        if(pitched) {
+          p_fxm->period = MIN((uint16_t)(p_fxm->period + fxp), PERIOD_MAX);
+          p_osc->freq = FREQ(p_fxm->period);
+        }
+        break;
+      case 0xE3: // Glissando control
+        p_fxm->glissando = (fxp != 0);
+        break;
+      case 0xE4: // Set vibrato waveform
+        p_fxm->vibr.mode = fxp;
+        break;
+      case 0xE5: // Set fine tune
+        p_fxm->tune = (fxp & 0x8) ? fxp - 0x10 : fxp;
+        break;
+      case 0xE7: // Set tremolo waveform
+        p_fxm->trem.mode = fxp;
+        break;
+      case 0xEA: // Fine volume slide up
+        p_osc->vol = VOL(p_fxm->volume = MIN(p_fxm->volume + fxp, 0x20));
+        break;
+      case 0xEB: // Fine volume slide down
+        p_osc->vol = VOL(p_fxm->volume = MAX(p_fxm->volume - fxp, 0));
+        break;
+      case 0xEE: // Delay
+        row_delay = fxp;
+        break;
+    }
+  } else {
 
-        // Effects processed when tick > 0
-        switch(fx) {
-          case 0x10: // Slide up
-            if(ch != 3) {
-              p_fxm->period = MAX(p_fxm->period - fxp, PERIOD_MIN);
-              p_osc->freq = FREQ(p_fxm->period);
-            }
-            break;
-          case 0x20: // Slide down
-            if(ch != 3) {
-              p_fxm->period = MIN(p_fxm->period + fxp, PERIOD_MAX);
-              p_osc->freq = FREQ(p_fxm->period);
-            }
-            break;
+    // Effects processed when tick > 0
+    switch(fx) {
+      case 0x10: // Slide up
+        if(pitched) {
+          p_fxm->period = MAX((uint16_t)(p_fxm->period - fxp), PERIOD_MIN);
+          p_osc->freq = FREQ(p_fxm->period);
+        }
+        break;
+      case 0x20: // Slide down
+        if(pitched) {
+          p_fxm->period = MIN((uint16_t)(p_fxm->period + fxp), PERIOD_MAX);
+          p_osc->freq = FREQ(p_fxm->period);
+        }
+        break;
 /*
-          // Just feels... ugly
-          case 0xE9: // Retrigger note
-            temp = tick; while(temp >= fxp) temp -= fxp;
-            if(!temp) {
-              if(ch == 3) {
-                p_osc->freq = p_osc->phase = 0x2000;
-              } else {
-                p_osc->phase = 0;
-              }
-            }
-            break;
+      // Just feels... ugly
+      case 0xE9: // Retrigger note
+        temp = tick; while(temp >= fxp) temp -= fxp;
+        if(!temp) {
+          if(ch == 3) {
+            p_osc->freq = p_osc->phase = 0x2000;
+          } else {
+            p_osc->phase = 0;
+          }
+        }
+        break;
 */            
-          case 0xEC: // Note cut
-            if(fxp == tick) p_osc->vol = 0x00;
-            break;
-          default:   // Multi-effect processing
-
-            // Portamento
-            if(ch != 3 && (fx == 0x30 || fx == 0x50)) {
-              if(p_fxm->period < p_fxm->port_target) p_fxm->period = MIN(p_fxm->period + p_fxm->port_speed,  p_fxm->port_target);
-              else                                   p_fxm->period = MAX(p_fxm->period - p_fxm->port_speed,  p_fxm->port_target);
-              if(p_fxm->glissando) p_osc->freq = FREQ(glissando(ch));
-              else                 p_osc->freq = FREQ(p_fxm->period);
-            }
-
-            // Volume slide
-            if(fx == 0x50 || fx == 0x60 || fx == 0xA0) {
-              if((fxp & 0xF0) == 0) p_fxm->volume -= (LO4(fxp));
-              if((fxp & 0x0F) == 0) p_fxm->volume += (HI4(fxp));
-              p_osc->vol = p_fxm->volume = MAX(MIN(p_fxm->volume, 0x20), 0);
-            }
+      case 0xEC: // Note cut
+        if(fxp == tick) p_osc->vol = VOL(0x00);
+        break;
+      default:   // Multi-effect processing
+
+        // Portamento
+        if(pitched && (flags & CEL_PORTA)) {
+          if(p_fxm->period < p_fxm->port_target) p_fxm->period = MIN((uint16_t)(p_fxm->period + p_fxm->port_speed), p_fxm->port_target);
+          else                                   p_fxm->period = MAX((uint16_t)(p_fxm->period - p_fxm->port_speed), p_fxm->port_target);
+          if(p_fxm->glissando) p_osc->freq = FREQ(glissando(ch));
+          else                 p_osc->freq = FREQ(p_fxm->period);
         }
-      }
 
-      // Normal play and arpeggio
-      if(fx == 0x00) {
-        if(ch != 3) {
-          temp = tick; while(temp > 2) temp -= 2;
-          if(temp == 0) {
+        // Volume slide
+        if(flags & CEL_VOLSLIDE) {
+          if((fxp & 0xF0) == 0) p_fxm->volume -= (LO4(fxp));
+          if((fxp & 0x0F) == 0) p_fxm->volume += (HI4(fxp));
+          p_osc->vol = VOL(p_fxm->volume = MAX(MIN(p_fxm->volume, 0x20), 0));
+        }
+    }
+  }
 
-            // Reset
-            p_osc->freq = FREQ(p_fxm->period);
-          } else if(fxp) {
+  // Normal play and arpeggio
+  if(flags & CEL_ARPEGGIO) {
+    if(pitched) {
+      temp = tick; while(temp > 2) temp -= 2;
+      if(temp == 0) {
 
-            // Arpeggio
-            p_osc->freq = FREQ(arpeggio(ch, (temp == 1 ? HI4(fxp) : LO4(fxp))));
-          }
-        }
-      } else if(fx == 0x40 || fx == 0x60) {
+        // Reset
+        p_osc->freq = FREQ(p_fxm->period);
+      } else if(fxp) {
 
-        // Vibrato
-        if(ch != 3) p_osc->freq = FREQ((p_fxm->period + do_osc(&p_fxm->vibr)));
-      } else if(fx == 0x70) {
-        int8_t trem = p_fxm->volume + do_osc(&p_fxm->trem);
-        p_osc->vol = MAX(MIN(trem, 0x20), 0);
+        // Arpeggio
+        p_osc->freq = FREQ(arpeggio(ch, (temp == 1 ? HI4(fxp) : LO4(fxp))));
       }
+    }
+  } else if(flags & CEL_VIBRATO) {
+
+    // Vibrato
+    if(pitched) p_osc->freq = FREQ((p_fxm->period + do_osc(&p_fxm->vibr)));
+  } else if(flags & CEL_TREMOLO) {
+    int8_t trem = p_fxm->volume + do_osc(&p_fxm->trem);
+    p_osc->vol = VOL(MAX(MIN(trem, 0x20), 0));
+  }
+}
+
+// Ends a tick, advancing playback
+static inline void playroutine_end() {
+
+  // Advance tick
+  if(++tick == speed) tick = 0;
+
+  // Advance playback
+  if(tick == 0) {
+    if(++ix_row == 64) {
+      ix_row = 0;
+      if(++ix_order >= order_count) ix_order = 0;
+    }
+    // Forced order/row
+    if( ix_nextorder != 0xFF ) {
+      ix_order = ix_nextorder;
+      ix_nextorder = 0xFF;
+    }
+    if( ix_nextrow != 0xFF ) {
+      ix_row = ix_nextrow;
+      ix_nextrow = 0xFF;
+    }
+    row_ready = decrunch_row();
+  }
+}
 
-      // Next channel
-      p_fxm++; p_cel++; p_osc++;
+// Progress module by one tick
+static inline void playroutine_tick() {
+  uint8_t ch, bit;
+  if(playroutine_begin()) {
+    // Ends right away when no channel has work left
+    for(ch = 0, bit = 1; tick_busy >= bit; ch++, bit <<= 1) {
+      if(tick_busy & bit) playroutine_channel(ch);
     }
+    playroutine_end();
+  }
+}
 
-    // Advance tick
-    if(++tick == speed) tick = 0;
+#ifdef SQUAWK_SPREAD_TICKS
+// Runs a tick one channel per call: the first call starts it, the one that
+// processes the last channel with work ends it
+static inline void playroutine_step() {
+  uint8_t ch, bit;
+  if(!spread_tick) {
+    if(!playroutine_begin()) return;
+    spread_tick = true;
+  }
+  if(tick_busy) {
+    for(ch = 0, bit = 1; !(tick_busy & bit); ch++, bit <<= 1);
+    tick_busy &= ~bit;
+    playroutine_channel(ch);
+  }
+  if(!tick_busy) {
+    playroutine_end();
+    spread_tick = false;
+  }
+}
+
+// Calls the playroutine again on the next sample while a tick is under way,
+// and moves the next tick back by as many samples to keep the tempo
+// Call with interrupts disabled, right after playroutine_step()
+static inline void playroutine_schedule() {
+  if(spread_tick) {
+    // cia_count was reloaded with cia when this step was called
+    spread_samples += cia - cia_count + 1;
+    cia_count = 1;
+  } else if(spread_samples) {
+    cia_count = cia_count > spread_samples ? cia_count - spread_samples : 1;
+    spread_samples = 0;
+  }
+}
+#endif
+
+// Starts a sound effect on its channel, unless one that matters more is
+// playing there - then it waits in the queue, if there is room
+// Call with interrupts disabled
+static bool sfx_start(const uint8_t *p_script, uint8_t ch, uint8_t priority) {
+  uint8_t bit = 1 << ch;
+  sfx_t *p_sfx = &sfx_play[ch];
+  if(sfx_active & bit) {
+    if(priority < p_sfx->priority) {
+      if(sfx_queued == SQUAWK_SFX_QUEUE) return false;
+      sfx_queue[sfx_queued].p_script = p_script;
+      sfx_queue[sfx_queued].channel  = ch;
+      sfx_queue[sfx_queued].priority = priority;
+      sfx_queued++;
+      return true;
+    }
+  } else {
+    // Melody carries on in the background
+    sfx_osc[ch] = osc[ch];
+  }
+  p_sfx->p_step   = p_script;
+  p_sfx->ticks    = 0;
+  p_sfx->priority = priority;
+  sfx_active |= bit;
+  return true;
+}
+
+// Hands the channel to the next sound effect waiting for it, or back to
+// the melody
+static void sfx_next(uint8_t ch) {
+  uint8_t n, best = 0xFF;
+  for(n = 0; n != sfx_queued; n++) {
+    if(sfx_queue[n].channel == ch && (best == 0xFF || sfx_queue[n].priority > sfx_queue[best].priority)) best = n;
+  }
+  if(best != 0xFF) {
+    sfx_play[ch].p_step   = sfx_queue[best].p_script;
+    sfx_play[ch].ticks    = 0;
+    sfx_play[ch].priority = sfx_queue[best].priority;
+    for(n = best + 1; n != sfx_queued; n++) sfx_queue[n - 1] = sfx_queue[n];
+    sfx_queued--;
+  } else {
+    osc[ch].vol   = sfx_osc[ch].vol;
+#ifdef SQUAWK_TABLES
+    osc[ch].table = sfx_osc[ch].table;
+#endif
+    // Noise channel frequency is its LFSR, not to be touched
+    if(!(squawk_noise & (1 << ch))) osc[ch].freq = sfx_osc[ch].freq;
+    sfx_active &= ~(1 << ch);
+  }
+}
 
-    // Advance playback
-    if(tick == 0) {
-      if(++ix_row == 64) {
-        ix_row = 0;
-        if(++ix_order >= order_count) ix_order = 0;
+// Advances the sound effects by a tick
+static void sfx_tick() {
+  sfx_t *p_sfx = sfx_play;
+  osc_t *p_osc = osc;
+  uint8_t ch, bit;
+  for(ch = 0, bit = 1; ch != 4; ch++, bit <<= 1, p_sfx++, p_osc++) {
+    if(!(sfx_active & bit)) continue;
+    if(p_sfx->ticks) {
+      if(p_sfx->period) p_sfx->period = MAX(MIN((int16_t)(p_sfx->period + p_sfx->slide), PERIOD_MAX), PERIOD_MIN);
+    } else {
+      // Next step: ticks, volume, period (big endian), slide per tick -
+      // or the next sound effect's first, at the end of the script
+      while(!(p_sfx->ticks = pgm_read_byte(p_sfx->p_step))) {
+        sfx_next(ch);
+        if(!(sfx_active & bit)) break;
       }
-	    // Forced order/row
-	    if( ix_nextorder != 0xFF ) {
-	      ix_order = ix_nextorder;
-	      ix_nextorder = 0xFF;
-	    }
-	    if( ix_nextrow != 0xFF ) {
-	      ix_row = ix_nextrow;
-	      ix_nextrow = 0xFF;
-	    }
-			decrunch_row();
+      if(!(sfx_active & bit)) continue;
+      p_osc->vol    = pgm_read_byte(p_sfx->p_step + 1);
+      p_sfx->period = (pgm_read_byte(p_sfx->p_step + 2) << 8) | pgm_read_byte(p_sfx->p_step + 3);
+      p_sfx->slide  = pgm_read_byte(p_sfx->p_step + 4);
+      p_sfx->p_step += 5;
     }
+    if(p_sfx->period && !(squawk_noise & bit)) p_osc->freq = squawk_freq(p_sfx->period);
+    p_sfx->ticks--;
+  }
+}
 
+// Plays a sound effect on a channel
+bool SquawkSynth::sfx(const uint8_t *p_script, uint8_t channel, uint8_t priority) {
+  bool started;
+  if(channel > 3) return false;
+  cli();
+  started = sfx_start(p_script, channel, priority);
+  sei();
+  return started;
+}
+
+// Stops the sound effects on a channel, waiting ones too
+void SquawkSynth::sfxStop(uint8_t channel) {
+  uint8_t n, kept = 0;
+  if(channel > 3) return;
+  cli();
+  for(n = 0; n != sfx_queued; n++) {
+    if(sfx_queue[n].channel != channel) sfx_queue[kept++] = sfx_queue[n];
   }
+  sfx_queued = kept;
+  if(sfx_active & (1 << channel)) sfx_next(channel);
+  sei();
+}
+
+// Returns true while a sound effect plays on a channel
+bool SquawkSynth::sfxPlaying(uint8_t channel) {
+  return sfx_active & (1 << channel);
+}
 
+// Enters an envelope stage, or the first after it that takes any ticks -
+// stages taking none jump straight to their volume
+static void env_stage(env_t *p_env, uint8_t stage, uint8_t bit) {
+  for(;; stage++) {
+    p_env->stage = stage;
+    switch(stage) {
+      case ENV_ATTACK:
+        p_env->ticks  = p_env->attack;
+        p_env->target = p_env->peak;
+        break;
+      case ENV_DECAY:
+        p_env->ticks  = p_env->decay;
+        p_env->target = (p_env->peak * (p_env->sustain + 1U)) >> 8;
+        break;
+      case ENV_SUSTAIN:
+        p_env->ticks  = 0;
+        return;
+      case ENV_RELEASE:
+        p_env->ticks  = p_env->release;
+        p_env->target = 0;
+        break;
+      default:
+        env_active &= ~bit;
+        return;
+    }
+    if(p_env->ticks) {
+      // The last tick lands on the target, steps only lead up to it
+      if(p_env->ticks > 1) p_env->step = ((int32_t)(p_env->target * 256U) - p_env->level) / p_env->ticks;
+      return;
+    }
+    p_env->level = p_env->target * 256U;
+  }
+}
+
+// Advances the note envelopes by a tick
+static void env_tick() {
+  env_t *p_env = env;
+  uint8_t ch, bit;
+  for(ch = 0, bit = 1; ch != 4; ch++, bit <<= 1, p_env++) {
+    if(!(env_active & bit) || !p_env->ticks) continue;
+    if(--p_env->ticks) {
+      p_env->level += p_env->step;
+    } else {
+      p_env->level = p_env->target * 256U;
+      env_stage(p_env, p_env->stage + 1, bit);
+    }
+    music_osc(ch)->vol = p_env->level >> 8;
+  }
+}
+
+// Sets the envelope of notes played on a channel
+void SquawkSynth::envelope(uint8_t channel, uint8_t attack, uint8_t decay, uint8_t sustain, uint8_t release) {
+  if(channel > 3) return;
+  cli();
+  env[channel].attack  = attack;
+  env[channel].decay   = decay;
+  env[channel].sustain = sustain;
+  env[channel].release = release;
+  sei();
+}
+
+// Starts a note on a channel, from its envelope's attack
+void SquawkSynth::noteOn(uint8_t channel, uint16_t period, uint8_t vol) {
+  env_t *p_env = env + (channel & 3);
+  osc_t *p_osc;
+  if(channel > 3) return;
+  cli();
+  p_osc = music_osc(channel);
+  // Noise channel frequency is its LFSR, not to be touched
+  if(!(squawk_noise & (1 << channel))) p_osc->freq = squawk_freq(period);
+  p_env->peak  = vol;
+  p_env->level = 0;
+  env_active |= 1 << channel;
+  env_stage(p_env, ENV_ATTACK, 1 << channel);
+  p_osc->vol = p_env->level >> 8;
+  sei();
+}
+
+// Releases the note on a channel
+void SquawkSynth::noteOff(uint8_t channel) {
+  if(channel > 3) return;
+  cli();
+  if(env_active & (1 << channel)) {
+    env_stage(&env[channel], ENV_RELEASE, 1 << channel);
+    music_osc(channel)->vol = env[channel].level >> 8;
+  }
+  sei();
+}
+
+// Returns true until the note on a channel has faded out
+bool SquawkSynth::notePlaying(uint8_t channel) {
+  return env_active & (1 << channel);
+}
+
+// Sets the melody's volume again after the mixer changed, on the channels
+// it has (notes don't take it)
+static void mix_apply() {
+  uint8_t ch;
+  if(!order_count) return;
+  for(ch = 0; ch != 4; ch++) {
+    if(!(env_active & (1 << ch))) music_osc(ch)->vol = mix_vol(ch, melody_vol[ch]);
+  }
+}
+
+// Advances the master volume fade by a tick
+static void mix_tick() {
+  if(--mix_ticks) mix_master += mix_step;
+  else            mix_master  = mix_target * 256U;
+  mix_apply();
+}
+
+// Mutes the melody on channels
+void SquawkSynth::mute(uint8_t mask) {
+  cli();
+  mix_mute = mask;
+  mix_apply();
+  sei();
+}
+
+// Sets the master volume, or fades to it
+void SquawkSynth::volume(uint8_t vol, uint16_t ticks) {
+  int32_t step = 0;
+  cli();
+  mix_ticks = 0;
+  sei();
+  if(ticks) step = ((int32_t)vol * 256 - mix_master) / ticks;
+  cli();
+  mix_target = vol;
+  if(ticks) {
+    mix_step  = step;
+    mix_ticks = ticks;
+  } else {
+    mix_master = vol * 256U;
+    mix_apply();
+  }
+  sei();
+}
+
+// Returns the master volume, as faded so far
+uint8_t SquawkSynth::volume() {
+  uint8_t vol;
+  cli();
+  vol = mix_master >> 8;
+  sei();
+  return vol;
+}
+
+#ifdef SQUAWK_STATS
+// Reads Timer1 and the sample count together, as one cycle count
+static uint32_t stats_clock() {
+  uint16_t timer, count;
+  cli();
+  timer = TCNT1;
+  count = cia_count;
+  // Sample interrupt pending, not counted yet
+  if((TIFR1 & _BV(OCF1A)) && timer < (OCR1A >> 1)) count--;
+  sei();
+  return (uint32_t)(uint16_t)-count * (OCR1A + 1) + timer;
+}
+#endif
+
+// Runs the playroutine for a tick, unless the previous tick is still busy
+// With SQUAWK_SPREAD_TICKS, runs the next step of the tick instead
+__attribute__((used)) void squawk_playroutine() {
+  static bool lockout = false;
+#ifdef SQUAWK_STATS
+  uint32_t start;
+  uint16_t count, cycles, dropped;
+#ifdef SQUAWK_SPREAD_TICKS
+  if(!spread_tick)
+#endif
+  stats_data.samples += cia;
+#endif
+
+#ifdef SQUAWK_PCM
+  // The grinder leaves PCM voice refills due now to the playroutine
+  squawk_pcm_refill();
+#endif
+
+  if(!order_count && !sfx_active && !env_active && !mix_ticks) return;
+
+  // Protect from re-entry via ISR
+  cli();
+  if(lockout) {
+#ifdef SQUAWK_STATS
+    stats_data.dropped++;
+#endif
+    sei();
+    return;
+  }
+  lockout = true;
+  sei();
+
+#ifdef SQUAWK_STATS
+  dropped = stats_data.dropped;
+  count   = cia_count;
+  start   = stats_clock();
+#endif
+
+  if(order_count) {
+#ifdef SQUAWK_SPREAD_TICKS
+    playroutine_step();
+#else
+    playroutine_tick();
+#endif
+  }
+
+  // Sound effects, once the melody's tick is done
+#ifdef SQUAWK_SPREAD_TICKS
+  if(sfx_active && !spread_tick) sfx_tick();
+  if(env_active && !spread_tick) env_tick();
+  if(mix_ticks && !spread_tick) mix_tick();
+#else
+  if(sfx_active) sfx_tick();
+  if(env_active) env_tick();
+  if(mix_ticks) mix_tick();
+#endif
+
+#ifdef SQUAWK_STATS
+  // Cycles spent, minus samples generated meanwhile - unless it ran so long
+  // that the next tick was dropped
+  if(dropped == stats_data.dropped) {
+    start  = stats_clock() - start;
+    count -= cia_count;
+    start -= MIN((uint32_t)count * squawk_grind_cycles, start);
+    cycles = MIN(start, 0xFFFF);
+    stats_data.ticks++;
+    stats_data.tick_cycles += cycles;
+    if(cycles > stats_data.tick_max) stats_data.tick_max = cycles;
+  }
+#endif
+
+#ifdef SQUAWK_SPREAD_TICKS
+  // No sample interrupt between scheduling the next step and unlocking
+  cli();
+  playroutine_schedule();
   lockout = false;
-}
\ No newline at end of file
+  sei();
+#else
+  lockout = false;
+#endif
+}
+
+// Starts counting CPU cycles with Timer1
+static inline void cycles_start() {
+  TCNT1 = 0;
+  TIFR1 = _BV(TOV1);
+}
+
+// Returns CPU cycles counted by Timer1, 0xFFFF if it overflowed
+static inline uint16_t cycles_read() {
+  uint16_t cycles = TCNT1;
+  return (TIFR1 & _BV(TOV1)) ? 0xFFFF : cycles;
+}
+
+// Measures average cost of a sample interrupt, over 256 of them - which
+// includes the refills of SQUAWK_CONSTRUCT_BUFFERED_ISR for any buffer size
+static uint16_t measure_grinder() {
+  volatile uint8_t *p_output = (volatile uint8_t *)squawk_register;
+  uint8_t output = *p_output;
+  uint16_t cycles;
+  uint8_t n = 0;
+  cia_count = 0xFFFF; // No ticks meanwhile
+  cli();
+  cycles_start();
+  do {
+#ifdef SQUAWK_HOST
+    squawk_grind();
+#else
+    TIMER1_COMPA_vect(); // returns with reti, enabling interrupts
+    cli();
+#endif
+  } while(++n);
+  cycles = cycles_read();
+  // Samples written meanwhile would be heard
+  *p_output = output;
+  sei();
+  return cycles == 0xFFFF ? 0x100 : MAX(cycles >> 8, 1);
+}
+
+// Playback state, kept by functions that play the melody through
+typedef struct {
+  osc_t    osc[4];
+  osc_t    sfx_osc[4];                 // The melody plays into these too
+  uint8_t  vol[4];
+  fxm_t    fxm[4];
+  uint8_t  speed, tick, row_delay;
+  uint8_t  order, row, next_order, next_row;
+  bool     jump;
+  uint16_t underruns;
+  bool     playing;
+} play_state_t;
+
+// Pauses playback, and saves its state
+static void play_state_save(play_state_t *p_state) {
+  p_state->playing = TIMSK1 & _BV(OCIE1A);
+  TIMSK1 = 0;
+  memcpy(p_state->osc, osc, sizeof(osc));
+  memcpy(p_state->sfx_osc, sfx_osc, sizeof(sfx_osc));
+  memcpy(p_state->vol, melody_vol, sizeof(melody_vol));
+  memcpy(p_state->fxm, fxm, sizeof(fxm));
+  p_state->speed      = speed;
+  p_state->tick       = tick;
+  p_state->row_delay  = row_delay;
+  p_state->order      = ix_order;
+  p_state->row        = ix_row;
+  p_state->next_order = ix_nextorder;
+  p_state->next_row   = ix_nextrow;
+  p_state->jump       = tick_jump;
+  p_state->underruns  = row_underruns;
+}
+
+// Puts playback back where it was saved, mid-row included - without
+// resuming it
+static void play_state_restore(const play_state_t *p_state) {
+  if(order_count) {
+    memcpy(fxm, p_state->fxm, sizeof(fxm));
+    speed = p_state->speed;
+    playroutine_position(p_state->order, p_state->row);
+    tick         = p_state->tick;
+    row_delay    = p_state->row_delay;
+    ix_nextorder = p_state->next_order;
+    ix_nextrow   = p_state->next_row;
+    tick_jump    = p_state->jump;
+    row_underruns = p_state->underruns;
+  }
+  memcpy(osc, p_state->osc, sizeof(osc));
+  memcpy(sfx_osc, p_state->sfx_osc, sizeof(sfx_osc));
+  memcpy(melody_vol, p_state->vol, sizeof(melody_vol));
+}
+
+// Measures worst tick of the loaded melody, playing it through once without
+// sound - timing the first, second and last tick of every row, the ticks in
+// between repeat the work of the second
+static uint16_t measure_melody() {
+  uint16_t cycles, worst = 0, rows;
+  for(rows = order_count * 64; rows; rows--) {
+    do {
+      if(tick == 2 && speed > 3) tick = speed - 1;
+      cli();
+      cycles_start();
+      playroutine_tick();
+      cycles = cycles_read();
+      sei();
+      if(cycles > worst) worst = cycles;
+    } while(tick != 0);
+  }
+  playroutine_reset();
+  return worst;
+}
+
+// Initializes Squawk at the highest sample rate within max_cpu_percent
+uint16_t SquawkSynth::beginAuto(uint8_t max_cpu_percent) {
+  uint16_t grinder, worst = 0, count = cia_count;
+  play_state_t saved;
+  int32_t budget;
+  uint32_t hz;
+
+  // Let Timer1 run free at CPU clock while measuring
+  play_state_save(&saved);
+  TCCR1A = 0b00000000;
+  TCCR1B = 0b00000001;
+#ifdef SQUAWK_PCM
+  // The PCM voice steps through its buffer meanwhile, but isn't refilled
+  uint8_t pcm_ix = squawk_pcm_ix, pcm_phase = squawk_pcm_phase;
+  pcm_busy = true;
+  grinder = measure_grinder();
+  squawk_pcm_ix    = pcm_ix;
+  squawk_pcm_phase = pcm_phase;
+  pcm_busy = false;
+#else
+  grinder = measure_grinder();
+#endif
+  if(order_count) worst = measure_melody();
+  play_state_restore(&saved);
+  cia_count = count;
+
+  // Cycles per second left for the sample grinder, after the worst ticks
+  budget = (int32_t)(F_CPU / 100) * max_cpu_percent - (int32_t)tick_rate * worst;
+  hz = budget > 0 ? budget / grinder : 0;
+  hz = MAX(MIN(hz, SAMPLE_RATE_MAX), SAMPLE_RATE_MIN);
+
+  // As begin(), but a PCM voice plays on, at the new sample rate
+  begin_rate(hz);
+#ifdef SQUAWK_PCM
+  cli();
+  if(squawk_pcm_step) squawk_pcm_step = pcm_step();
+  sei();
+#endif
+  if(saved.playing) play();
+  return hz;
+}
+
+// Writes the state at the start of the current row to a seek index entry
+static void snapshot_save(uint8_t *p_snap) {
+  fxm_t *p_fxm = fxm;
+  uint8_t ch, sounding = 0;
+  *p_snap++ = speed;
+  for(ch = 0; ch != 4; ch++) if(music_osc(ch)->freq) sounding |= 1 << ch;
+  *p_snap++ = sounding;
+  for(ch = 0; ch != 4; ch++, p_fxm++) {
+    *p_snap++ = p_fxm->volume;
+    *p_snap++ = p_fxm->port_speed;
+    *p_snap++ = p_fxm->port_target >> 8;
+    *p_snap++ = p_fxm->port_target;
+    *p_snap++ = p_fxm->glissando;
+    *p_snap++ = p_fxm->vibr.fxp;
+    *p_snap++ = p_fxm->vibr.offset;
+    *p_snap++ = p_fxm->vibr.mode;
+    *p_snap++ = p_fxm->trem.fxp;
+    *p_snap++ = p_fxm->trem.offset;
+    *p_snap++ = p_fxm->trem.mode;
+    *p_snap++ = p_fxm->period >> 8;
+    *p_snap++ = p_fxm->period;
+    *p_snap++ = p_fxm->pitch >> 8;
+    *p_snap++ = p_fxm->pitch;
+    *p_snap++ = p_fxm->note;
+    *p_snap++ = p_fxm->param;
+    *p_snap++ = p_fxm->tune;
+    *p_snap++ = melody_vol[ch];
+    *p_snap++ = p_fxm->table;
+  }
+}
+
+// Restores the state at the start of an order from the seek index, returns
+// false if playback never gets there
+static bool snapshot_load(uint8_t ix_ord) {
+  fxm_t *p_fxm = fxm;
+  osc_t *p_osc;
+  uint8_t ch, bit, sounding;
+  stream_cursor = STREAM_LOST;
+  stream->seek(index_base + ix_ord * SQUAWK_SNAPSHOT_SIZE);
+  if(!(speed = stream->read())) return false;
+  sounding = stream->read();
+  for(ch = 0, bit = 1; ch != 4; ch++, bit <<= 1, p_fxm++) {
+    p_osc = music_osc(ch);
+    p_fxm->volume       = stream->read();
+    p_fxm->port_speed   = stream->read();
+    p_fxm->port_target  = stream->read() << 8;
+    p_fxm->port_target |= stream->read();
+    p_fxm->glissando    = stream->read();
+    p_fxm->vibr.fxp     = stream->read();
+    p_fxm->vibr.offset  = stream->read();
+    p_fxm->vibr.mode    = stream->read();
+    p_fxm->trem.fxp     = stream->read();
+    p_fxm->trem.offset  = stream->read();
+    p_fxm->trem.mode    = stream->read();
+    p_fxm->period       = stream->read() << 8;
+    p_fxm->period      |= stream->read();
+    p_fxm->pitch        = stream->read() << 8;
+    p_fxm->pitch       |= stream->read();
+    p_fxm->note         = stream->read();
+    p_fxm->param        = stream->read();
+    p_fxm->tune         = stream->read();
+    p_osc->vol          = VOL(stream->read());
+    p_fxm->table        = stream->read();
+#ifdef SQUAWK_TABLES
+    wave_select(ch);
+#endif
+    // Frequency depends on sample rate and tuning, so the period it was
+    // played at is stored instead, and whether it was 0 (no note yet)
+    if(!(squawk_noise & bit)) p_osc->freq = (sounding & bit) ? FREQ(p_fxm->pitch) : 0;
+  }
+  return true;
+}
+
+// Plays a whole row without sound, row delay included
+static void play_row() {
+  do playroutine_tick(); while(tick != 0 || row_delay);
+}
+
+// Plays rows without sound until order/row is reached, or rows run out
+static bool fast_forward(uint8_t ix_ord, uint8_t ix_r, uint16_t rows) {
+  while(ix_order != ix_ord || ix_row != ix_r) {
+    if(!rows--) return false;
+    play_row();
+  }
+  return true;
+}
+
+// Jumps to order/row, with the state playback would have there
+void SquawkSynth::seek(uint8_t ix_ord, uint8_t ix_r) {
+  bool playing = TIMSK1 & _BV(OCIE1A);
+  uint16_t underruns = row_underruns;
+  uint8_t n;
+  if(ix_ord >= order_count || ix_r > 63) return;
+  pause();
+  if(index_base && snapshot_load(ix_ord)) {
+    // From the start of the order - straight there if jumps get in the way
+    playroutine_position(ix_ord, 0);
+    if(!fast_forward(ix_ord, ix_r, 64)) playroutine_position(ix_ord, ix_r);
+  } else {
+    // From the start of the melody, unless it never gets there
+    for(n = 0; n != 4; n++) music_osc(n)->vol = melody_vol[n] = 0;
+    playroutine_reset();
+    if(!fast_forward(ix_ord, ix_r, order_count * 64)) playroutine_position(ix_ord, ix_r);
+  }
+  // Rows read on the way don't count
+  row_underruns = underruns;
+  if(playing) play();
+}
+
+// Writes the seek index of the loaded melody, noting the state the first
+// time playback reaches the start of each order
+uint16_t SquawkSynth::index(uint8_t *p_index) {
+  uint16_t rows, size = order_count * SQUAWK_SNAPSHOT_SIZE;
+  osc_t saved[4];
+  uint8_t saved_vol[4];
+  uint8_t *p_snap;
+  pause();
+  memcpy(saved, osc, sizeof(osc));
+  memcpy(saved_vol, melody_vol, sizeof(melody_vol));
+  memset(p_index, 0, size);
+  playroutine_reset();
+  for(rows = order_count * 64; rows; rows--) {
+    p_snap = &p_index[ix_order * SQUAWK_SNAPSHOT_SIZE];
+    if(ix_row == 0 && !p_snap[0]) snapshot_save(p_snap);
+    play_row();
+  }
+  playroutine_reset();
+  memcpy(osc, saved, sizeof(osc));
+  memcpy(melody_vol, saved_vol, sizeof(melody_vol));
+  return size;
+}
+
+// Returns the position played after order/row (order in the high byte)
+static uint16_t scan_next(uint16_t position) {
+  cel_t row[4];
+  uint8_t ix_ord = position >> 8, ix_r = position;
+  fetch_row(ix_ord, ix_r, row);
+  next_position(row, &ix_ord, &ix_r);
+  return (ix_ord << 8) | ix_r;
+}
+
+// Plays the melody through without sound, tick by tick
+squawk_scan_t SquawkSynth::scan(void (*row_played)(uint8_t order, uint8_t row, uint32_t tick)) {
+  squawk_scan_t result;
+  uint16_t power, length, rows, first, last;
+  uint16_t cycles;
+  uint8_t tccr1a = TCCR1A, tccr1b = TCCR1B;
+  play_state_t saved;
+
+  memset(&result, 0, sizeof(result));
+  if(!order_count) return result;
+  play_state_save(&saved);
+
+  // Positions follow from the rows alone, so find where they start over
+  // (Brent's cycle detection) without playing: length of the repeated part,
+  // then the rows before it
+  power = length = 1;
+  first = 0;
+  last  = scan_next(0);
+  while(first != last) {
+    if(power == length) {
+      first  = last;
+      power *= 2;
+      length = 0;
+    }
+    last = scan_next(last);
+    length++;
+  }
+  first = last = 0;
+  for(rows = length; rows; rows--) last = scan_next(last);
+  for(rows = 0; first != last; rows++) {
+    first = scan_next(first);
+    last  = scan_next(last);
+  }
+  result.loop_order = first >> 8;
+  result.loop_row   = first;
+
+  // Play it, with Timer1 running free at CPU clock to time the ticks
+  TCCR1A = 0b00000000;
+  TCCR1B = 0b00000001;
+  playroutine_reset();
+  for(rows += length; rows; rows--) {
+    if(rows == length) result.loop_tick = result.ticks;
+    if(row_played) row_played(ix_order, ix_row, result.ticks);
+    do {
+      cli();
+      cycles_start();
+      playroutine_tick();
+      cycles = cycles_read();
+      sei();
+      if(cycles > result.tick_max) result.tick_max = cycles;
+      result.ticks++;
+    } while(tick != 0 || row_delay);
+  }
+  play_state_restore(&saved);
+  TCCR1A = tccr1a;
+  TCCR1B = tccr1b;
+  if(saved.playing) play();
+  return result;
+}
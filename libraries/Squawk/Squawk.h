@@ -16,9 +16,76 @@ class SquawkStream {
 	  virtual ~SquawkStream() = 0;
     virtual uint8_t read() = 0;
     virtual void seek(size_t offset) = 0;
+    // Reads count bytes, override where that beats reading them one by one
+    virtual void read(uint8_t *p_dst, uint8_t count) { while(count--) *p_dst++ = read(); }
+    // Whether the sample ISR may read rows service() has not read in time -
+    // streams that share a bus with the sketch say no, and need service()
+    virtual bool readInISR() { return true; }
 };
 inline SquawkStream::~SquawkStream() { }
 
+// Uncomment to make Squawk.stats() available, which costs a few cycles
+// per playroutine tick - or define it on the compiler command line
+//#define SQUAWK_STATS
+
+// Uncomment to spread each playroutine tick over consecutive samples, one
+// channel per sample interrupt, rather than run it all in one - which
+// should cut the longest time spent in the interrupt about fourfold (not
+// measured yet). The tempo stays the same; Squawk.stats() then times the
+// steps rather than whole ticks
+//#define SQUAWK_SPREAD_TICKS
+
+// Uncomment to add a PCM voice, see SquawkSynth::pcmPlay(), which costs up
+// to SQUAWK_CYCLES_PCM cycles per sample and SQUAWK_PCM_BUFFER bytes of RAM
+//#define SQUAWK_PCM
+
+// Uncomment for TABLE and TABLE_RAM channels, see SQUAWK_CONSTRUCT_ISR_EX and
+// SquawkSynth::waveTables(), which cost a table pointer in every oscillator
+//#define SQUAWK_TABLES
+
+// Size of the PCM voice's sample buffer, a power of two up to 256, refilled
+// half at a time. Define it before including Squawk.h to change it - also
+// for Squawk.cpp (on the compiler command line), which needs the same size
+#ifndef SQUAWK_PCM_BUFFER
+#define SQUAWK_PCM_BUFFER 64
+#endif
+
+// PCM sample formats, for SquawkSynth::pcmPlay()
+#define SQUAWK_PCM_8BIT 8 // Signed 8-bit
+#define SQUAWK_PCM_4BIT 4 // Signed 4-bit, two per byte, high nibble first
+
+#ifdef SQUAWK_STATS
+// Playback statistics
+typedef struct {
+  uint32_t samples;  // Samples generated
+  uint32_t ticks;    // Playroutine ticks run
+  uint16_t dropped;  // Ticks dropped because the previous was still running
+  uint16_t tick_max; // Most CPU cycles spent in a tick
+  uint16_t tick_avg; // Average CPU cycles spent in a tick
+  uint8_t  cpu;      // Estimated CPU use in percent, grinder included
+} squawk_stats_t;
+#endif
+
+// Melody timeline, see SquawkSynth::scan()
+typedef struct {
+  uint32_t ticks;      // Ticks played before the melody starts over
+  uint32_t loop_tick;  // Tick the part it repeats starts at
+  uint8_t  loop_order; // Position the part it repeats starts at
+  uint8_t  loop_row;
+  uint16_t tick_max;   // Most CPU cycles spent in a tick (0 on a PC)
+} squawk_scan_t;
+
+// Bytes per order in a seek index, see SquawkSynth::index()
+#define SQUAWK_SNAPSHOT_SIZE 82
+
+// Sound effect script step, for SquawkSynth::sfx(): plays PERIOD (as in
+// ProTracker, 0 keeps the frequency) at volume VOL (as osc[].vol) for TICKS
+// playroutine ticks (1-255), adding SLIDE (-128-127) to the period every tick
+// A script is a PROGMEM array of steps, ending with SQUAWK_SFX_END
+#define SQUAWK_SFX(TICKS, VOL, PERIOD, SLIDE) \
+  (TICKS), (VOL), (uint8_t)((PERIOD) >> 8), (uint8_t)(PERIOD), (uint8_t)(SLIDE)
+#define SQUAWK_SFX_END 0
+
 class SquawkSynth {
 
 protected:
@@ -33,9 +100,19 @@ public:
   // Initialize Squawk to generate samples at sample_rate Hz
   void begin(uint16_t sample_rate);
 
+  // Initialize Squawk at the highest sample rate (up to 44100Hz) that keeps
+  // its CPU use within max_cpu_percent, measured on this Arduino - with the
+  // melody already loaded (by play()) included, returns the sample rate.
+  // The melody, sound effects and PCM voice play on from where they were
+  uint16_t beginAuto(uint8_t max_cpu_percent);
+
   // Load and play specified melody
   // melody needs to point to PROGMEM data
   void play(const uint8_t *melody);
+
+  // Load and play a melody in RAM, a .sqm file loaded there say (see
+  // SquawkSD::play()) - melody stays in use
+  void playRAM(const uint8_t *melody);
   
   // Resume currently loaded melody (or enable direct osc manipulation by sketch)
   void play();
@@ -51,6 +128,106 @@ public:
 
   // Change the tempo - default is 50
 	void tempo(uint16_t tempo);
+
+  // Prefetch upcoming rows of the melody - call it often from loop() when
+  // playing from SD card, so the sample ISR never waits for the card. Rows
+  // it has not read in time, and all rows without it, are still read from
+  // the stream inside the sample ISR
+  void service();
+
+  // Number of rows service() did not have ready when they were due, since
+  // play() - counted once service() has been called
+  uint16_t rowUnderruns();
+
+  // Jump to order/row of the loaded melody, with the speed, volumes and
+  // effect memory playback would have there - right away if the melody has
+  // a seek index (added by convert/src/squawk-index), otherwise by playing
+  // up to it without sound
+  void seek(uint8_t order, uint8_t row);
+
+  // Play the loaded melody through without sound, and write its seek index
+  // to p_index: SQUAWK_SNAPSHOT_SIZE bytes for every order - returns its
+  // size, leaves playback paused at the start
+  uint16_t index(uint8_t *p_index);
+
+  // Play the loaded melody through once without sound, calling row_played
+  // (if given) with the tick every row starts at - returns its length, loop
+  // point and heaviest tick, then playback carries on where it was. Takes
+  // the playroutine's time for every tick of the melody, 384 per order at
+  // speed 6 - not measured on an Arduino yet, 0.1 to 0.5 ms on a PC for the
+  // melodies in convert/music (1500 to 3600 ticks)
+  squawk_scan_t scan(void (*row_played)(uint8_t order, uint8_t row, uint32_t tick) = NULL);
+
+  // Play a sound effect script (in PROGMEM, see SQUAWK_SFX) on channel 0-3
+  // instead of the melody, which carries on silently there meanwhile - one
+  // playing there already keeps it if its priority is higher, and this one
+  // waits its turn (returns false if the queue is full), otherwise it stops
+  // On the noise channel, only volume is played
+  bool sfx(const uint8_t *script, uint8_t channel, uint8_t priority = 0);
+
+  // Stop sound effects on a channel, waiting ones too
+  void sfxStop(uint8_t channel);
+
+  // Is a sound effect playing on a channel?
+  bool sfxPlaying(uint8_t channel);
+
+#ifdef SQUAWK_PCM
+  // Play length PCM samples from PROGMEM (or a stream, from offset on) on
+  // the PCM voice, in format SQUAWK_PCM_8BIT or SQUAWK_PCM_4BIT, at rate Hz
+  // (up to the sample rate) and volume vol - 0x20 is as loud as a channel
+  // at full volume, up to 0x80. Stops what the voice was playing. Streams
+  // are read by service(), which then needs calling often from loop()
+  void pcmPlay(const uint8_t *data, uint32_t length, uint16_t rate, uint8_t vol = 0x20, uint8_t format = SQUAWK_PCM_8BIT);
+  void pcmPlay(SquawkStream *data, size_t offset, uint32_t length, uint16_t rate, uint8_t vol = 0x20, uint8_t format = SQUAWK_PCM_8BIT);
+
+  // Stop the PCM voice
+  void pcmStop();
+
+  // Is the PCM voice playing?
+  bool pcmPlaying();
+#endif
+
+  // Envelope of notes played on channel 0-3 with noteOn(), in playroutine
+  // ticks (50 per second at the default tempo): attack rises to the note's
+  // volume, decay falls to sustain (0-255, 255 keeps all of it), held until
+  // noteOff(), then release falls to silence - 0 ticks jumps there
+  void envelope(uint8_t channel, uint8_t attack, uint8_t decay, uint8_t sustain, uint8_t release);
+
+  // Play a note on a channel without a melody on it, ProTracker period
+  // (as in SQUAWK_SFX), volume as osc[].vol - and release it. Sound effects
+  // play over the note, as over the melody
+  void noteOn(uint8_t channel, uint16_t period, uint8_t vol = 0x20);
+  void noteOff(uint8_t channel);
+
+  // Is a note playing on a channel, release included?
+  bool notePlaying(uint8_t channel);
+
+  // Mute the melody on the channels with their bit set in mask (bit 0 for
+  // channel 0), unmuting the others - mute(0x0F & ~(1 << channel)) solos a
+  // channel. Sound effects and notes still play there
+  void mute(uint8_t mask);
+
+  // Master volume of the melody, 0-255 (255 leaves it as it is) - fading
+  // there over ticks playroutine ticks, if given
+  void volume(uint8_t vol, uint16_t ticks = 0);
+  uint8_t volume();
+
+#ifdef SQUAWK_TABLES
+  // Wave tables for TABLE and TABLE_RAM channels (see SQUAWK_CONSTRUCT_ISR_EX),
+  // picked by the melody with effect 8xx (converted by mod2squawk -fw/-aw
+  // from instrument numbers) - table 0 until then. tables stays in use, the
+  // tables in it are in PROGMEM for TABLE channels, in RAM for TABLE_RAM
+  void waveTables(const int8_t * const *tables, uint8_t count);
+#endif
+
+  // Number of times SQUAWK_CONSTRUCT_BUFFERED_ISR ran out of samples
+  uint16_t sampleUnderruns();
+
+#ifdef SQUAWK_STATS
+  // Playback statistics since begin(), cycle counts are measured with
+  // Timer1 and don't cover SQUAWK_CONSTRUCT_BUFFERED_ISR rendering
+  squawk_stats_t stats();
+#endif
 };
 
 extern SquawkSynth Squawk;
@@ -60,17 +237,24 @@ typedef struct {
   uint8_t  vol;
   uint16_t freq;
   uint16_t phase;
+#ifdef SQUAWK_TABLES
+  const int8_t *table; // Wave table, for TABLE and TABLE_RAM channels
+#endif
 } osc_t;
 
 typedef osc_t Oscillator;
 
 // oscillator memory
 extern osc_t osc[4];
+// pcm is added to every sample, 128 centers the output - with SQUAWK_PCM
+// the PCM voice plays around it, and a new value takes effect with the next
+// pcmPlay() or pcmStop()
 extern uint8_t pcm;
 // channel 0 is pulse wave @ 25% duty
 // channel 1 is square wave
 // channel 2 is triangle wave
 // channel 3 is noise
+// (unless constructed otherwise with SQUAWK_CONSTRUCT_ISR_EX)
 
 // For channel 3, freq is used as part of its LFSR and should not be changed.
 // LFSR: Linear feedback shift register, a method of producing a
@@ -117,118 +301,401 @@ extern uint8_t pcm;
 
 extern void squawk_playroutine() asm("squawk_playroutine");
 
-// SAMPLE GRINDER
-// generates samples and updates oscillators
-// uses 132 cycles (not counting playroutine)
-//     ~1/3 CPU @ 44kHz on 16MHz
+// Period to oscillator frequency, as used by the playroutine
+extern uint16_t squawk_freq(uint16_t period);
 
-//ISR(TIMER4_OVF_vect, ISR_NAKED) { // For Arduboy
+// Block sample renderer, used by SQUAWK_CONSTRUCT_BUFFERED_ISR
+// renders count samples with the playroutine running when due, stored
+// minus 128 - so an empty buffer plays silence
+extern void squawk_render(uint8_t *p_buffer, uint8_t count);
+extern void squawk_refill() asm("squawk_refill");
+
+// PCM voice buffer, played by the sample grinder instead of pcm when built
+// with SQUAWK_PCM: it moves on to the next sample every 256 / squawk_pcm_step
+// samples, and calls squawk_pcm_refill() on stepping into the other half
+extern uint8_t squawk_pcm_buffer[SQUAWK_PCM_BUFFER];
+extern uint8_t squawk_pcm_ix;
+extern uint8_t squawk_pcm_phase;
+extern uint8_t squawk_pcm_step;
+extern void squawk_pcm_refill() asm("squawk_pcm_refill");
+extern uint16_t squawk_buffer_underruns;
+
+// Size of sample buffer, a power of two up to 256, refilled half at a time
+#ifndef SQUAWK_BUFFER_SIZE
+#define SQUAWK_BUFFER_SIZE 64
+#endif
+
+// Buffer half not being played, refilled by squawk_refill() - which runs
+// with interrupts enabled, a refill still running when the next is due
+// counts as an underrun
+#define SQUAWK_CONSTRUCT_REFILL() \
+uint8_t squawk_buffer[SQUAWK_BUFFER_SIZE] __attribute__((used)); \
+uint8_t squawk_buffer_ix __attribute__((used)); \
+void squawk_refill() { \
+  static volatile bool busy = false; \
+  if(busy) { \
+    squawk_buffer_underruns++; \
+    return; \
+  } \
+  busy = true; \
+  squawk_render(&squawk_buffer[(squawk_buffer_ix & (SQUAWK_BUFFER_SIZE / 2)) ^ (SQUAWK_BUFFER_SIZE / 2)], SQUAWK_BUFFER_SIZE / 2); \
+  busy = false; \
+}
+
+// Waveforms for SQUAWK_CONSTRUCT_ISR_EX, per oscillator slot
+#define SQUAWK_WAVE_OFF      0
+#define SQUAWK_WAVE_PULSE    1 // 25% duty
+#define SQUAWK_WAVE_SQUARE   2
+#define SQUAWK_WAVE_TRIANGLE 3
+#define SQUAWK_WAVE_NOISE    4 // freq is the LFSR
+#ifdef SQUAWK_TABLES
+#define SQUAWK_WAVE_TABLE    5 // table in PROGMEM
+#define SQUAWK_WAVE_TABLE_RAM 6 // table in RAM
+
+// Entries in a wave table, 32 or 64, of signed samples - indexed by the
+// phase's top bits. Define it before including Squawk.h to change it
+#ifndef SQUAWK_TABLE_SIZE
+#define SQUAWK_TABLE_SIZE 32
+#endif
+
+// Sine the TABLE and TABLE_RAM channels play until the melody or the sketch
+// picks another table, so none ever reads through a NULL table
+#if SQUAWK_TABLE_SIZE == 64
+#define SQUAWK_SINE \
+     0,   12,   25,   37,   49,   60,   71,   81,   90,   98,  106,  112,  117,  122,  125,  126, \
+   127,  126,  125,  122,  117,  112,  106,   98,   90,   81,   71,   60,   49,   37,   25,   12, \
+     0,  -12,  -25,  -37,  -49,  -60,  -71,  -81,  -90,  -98, -106, -112, -117, -122, -125, -126, \
+  -127, -126, -125, -122, -117, -112, -106,  -98,  -90,  -81,  -71,  -60,  -49,  -37,  -25,  -12
+#else
+#define SQUAWK_SINE \
+     0,   25,   49,   71,   90,  106,  117,  125,  127,  125,  117,  106,   90,   71,   49,   25, \
+     0,  -25,  -49,  -71,  -90, -106, -117, -125, -127, -125, -117, -106,  -90,  -71,  -49,  -25
+#endif
+#endif
+
+// Cycles the sample grinder costs per sample besides its waveforms:
+// interrupt entry and return, registers, output and the tick count
+#define SQUAWK_CYCLES_GRIND    52
+
+// Cycles each waveform costs per sample, for Squawk.stats()
+#define SQUAWK_CYCLES_OFF      0
+#define SQUAWK_CYCLES_PULSE    22
+#define SQUAWK_CYCLES_SQUARE   19
+#define SQUAWK_CYCLES_TRIANGLE 25
+#define SQUAWK_CYCLES_NOISE    20
+#ifdef SQUAWK_TABLES
+#define SQUAWK_CYCLES_TABLE    (SQUAWK_TABLE_SIZE == 64 ? 41 : 42)
+#define SQUAWK_CYCLES_TABLE_RAM (SQUAWK_TABLE_SIZE == 64 ? 40 : 41)
+#endif
+
+// Cycles the PCM voice adds per sample, not counting refills
+#define SQUAWK_CYCLES_PCM      24
+
+#ifdef SQUAWK_PCM
+#define SQUAWK_CYCLES_MIX SQUAWK_CYCLES_PCM
+#else
+#define SQUAWK_CYCLES_MIX 0
+#endif
+
+#ifdef SQUAWK_STATS
+#define SQUAWK_CONSTRUCT_CYCLES(CYCLES) \
+uint8_t squawk_grind_cycles = (CYCLES);
+#else
+#define SQUAWK_CONSTRUCT_CYCLES(CYCLES)
+#endif
+
+// Channel masks for the playroutine, which skips channels that are off
+// and doesn't touch freq of noise channels
+#define SQUAWK_CONSTRUCT_MASKS(W0, W1, W2, W3) \
+uint8_t squawk_channels __attribute__((used)) = \
+  (SQUAWK_WAVE_##W0 != SQUAWK_WAVE_OFF) << 0 | (SQUAWK_WAVE_##W1 != SQUAWK_WAVE_OFF) << 1 | \
+  (SQUAWK_WAVE_##W2 != SQUAWK_WAVE_OFF) << 2 | (SQUAWK_WAVE_##W3 != SQUAWK_WAVE_OFF) << 3; \
+uint8_t squawk_noise __attribute__((used)) = \
+  (SQUAWK_WAVE_##W0 == SQUAWK_WAVE_NOISE) << 0 | (SQUAWK_WAVE_##W1 == SQUAWK_WAVE_NOISE) << 1 | \
+  (SQUAWK_WAVE_##W2 == SQUAWK_WAVE_NOISE) << 2 | (SQUAWK_WAVE_##W3 == SQUAWK_WAVE_NOISE) << 3; \
+SQUAWK_CONSTRUCT_TABLES(W0, W1, W2, W3)
+
+#ifdef SQUAWK_TABLES
+// Wave table each oscillator starts with, set by begin(): the sine, in RAM
+// for TABLE_RAM channels - the RAM copy is only linked in for those
+#define SQUAWK_TABLE_INIT_OFF       squawk_sine
+#define SQUAWK_TABLE_INIT_PULSE     squawk_sine
+#define SQUAWK_TABLE_INIT_SQUARE    squawk_sine
+#define SQUAWK_TABLE_INIT_TRIANGLE  squawk_sine
+#define SQUAWK_TABLE_INIT_NOISE     squawk_sine
+#define SQUAWK_TABLE_INIT_TABLE     squawk_sine
+#define SQUAWK_TABLE_INIT_TABLE_RAM squawk_sine_ram
+#define SQUAWK_CONSTRUCT_TABLES(W0, W1, W2, W3) \
+static const int8_t squawk_sine[SQUAWK_TABLE_SIZE] PROGMEM = { SQUAWK_SINE }; \
+int8_t squawk_sine_ram[SQUAWK_TABLE_SIZE] = { SQUAWK_SINE }; \
+extern const int8_t * const squawk_table_init[4]; \
+const int8_t * const squawk_table_init[4] PROGMEM = { \
+  SQUAWK_TABLE_INIT_##W0, SQUAWK_TABLE_INIT_##W1, SQUAWK_TABLE_INIT_##W2, SQUAWK_TABLE_INIT_##W3 \
+};
+#else
+#define SQUAWK_CONSTRUCT_TABLES(W0, W1, W2, W3)
+#endif
+
+// The standard four channels: pulse, square, triangle and noise
 #define SQUAWK_CONSTRUCT_ISR(TARGET_REGISTER) \
-uint16_t cia __attribute__((used)); \
-uint16_t cia_count __attribute__((used)); \
-intptr_t squawk_register __attribute__((used)) = (intptr_t)&TARGET_REGISTER; \
-ISR(TIMER1_COMPA_vect, ISR_NAKED) { \
-  asm volatile( \
-    "push r2                                          " "\n\t" \
-    "in   r2,                    __SREG__             " "\n\t" \
-    "push r18                                         " "\n\t" \
-    "push r27                                         " "\n\t" \
-    "push r26                                         " "\n\t" \
-    "push r0                                          " "\n\t" \
-    "push r1                                          " "\n\t" \
+  SQUAWK_CONSTRUCT_ISR_EX(TARGET_REGISTER, PULSE, SQUARE, TRIANGLE, NOISE)
+
+#ifdef SQUAWK_HOST
+
+// PORTABLE SAMPLE GRINDER
+// for host builds (see convert/src/host), mirrors the assembly version below
+// bit for bit - call squawk_grind() once per sample, it returns the sample
+// and writes it to TARGET_REGISTER
+extern uint8_t squawk_grind();
+
+// Waveforms, each adds output of oscillator N to sample
+#define SQUAWK_GRIND_OFF(N)
+#define SQUAWK_GRIND_PULSE(N) \
+  osc[N].phase += osc[N].freq; \
+  hi = osc[N].phase >> 8; \
+  sample += (hi & (hi << 1) & 0x80) ? -osc[N].vol : osc[N].vol;
+#define SQUAWK_GRIND_SQUARE(N) \
+  osc[N].phase += osc[N].freq; \
+  hi = osc[N].phase >> 8; \
+  sample += (hi & 0x80) ? -osc[N].vol : osc[N].vol;
+#define SQUAWK_GRIND_TRIANGLE(N) \
+  osc[N].phase += osc[N].freq; \
+  hi = osc[N].phase >> 8; \
+  hi = ((hi & 0x80) ? ~hi : hi) << 1; \
+  hi -= 128; \
+  sample += (uint8_t)(((int8_t)hi * (int8_t)osc[N].vol) >> 8) << 1;
+#define SQUAWK_GRIND_NOISE(N) \
+  lfsr = osc[N].freq << 1; \
+  if(lfsr & 0x8000) lfsr ^= 1; \
+  if(lfsr & 0x4000) lfsr ^= 1; \
+  osc[N].freq = lfsr; \
+  sample += (lfsr & 0x8000) ? -osc[N].vol : osc[N].vol;
+#ifdef SQUAWK_TABLES
+#define SQUAWK_GRIND_TABLE(N) \
+  osc[N].phase += osc[N].freq; \
+  hi = pgm_read_byte(&osc[N].table[(osc[N].phase >> 8) / (256 / SQUAWK_TABLE_SIZE)]); \
+  sample += (uint8_t)(((int8_t)hi * (int8_t)osc[N].vol) >> 8) << 1;
+#define SQUAWK_GRIND_TABLE_RAM(N) \
+  osc[N].phase += osc[N].freq; \
+  hi = osc[N].table[(osc[N].phase >> 8) / (256 / SQUAWK_TABLE_SIZE)]; \
+  sample += (uint8_t)(((int8_t)hi * (int8_t)osc[N].vol) >> 8) << 1;
+#endif
+
+// Start of the sample: pcm, or the PCM voice's sample - then the refill the
+// PCM voice asks for, unless the playroutine ran (which refills too)
+#ifdef SQUAWK_PCM
+#define SQUAWK_GRIND_MIX \
+  bool refill = false; \
+  squawk_pcm_phase += squawk_pcm_step; \
+  if(squawk_pcm_phase < squawk_pcm_step) { \
+    squawk_pcm_ix = (squawk_pcm_ix + 1) & (SQUAWK_PCM_BUFFER - 1); \
+    refill = !(squawk_pcm_ix & (SQUAWK_PCM_BUFFER / 2 - 1)); \
+  } \
+  sample = squawk_pcm_buffer[squawk_pcm_ix];
+#define SQUAWK_GRIND_REFILL \
+  else if(refill) squawk_pcm_refill();
+#else
+#define SQUAWK_GRIND_MIX \
+  sample = pcm;
+#define SQUAWK_GRIND_REFILL
+#endif
+
+#define SQUAWK_CONSTRUCT_ISR_EX(TARGET_REGISTER, W0, W1, W2, W3) \
+uint16_t cia; \
+uint16_t cia_count; \
+intptr_t squawk_register = (intptr_t)&TARGET_REGISTER; \
+SQUAWK_CONSTRUCT_MASKS(W0, W1, W2, W3) \
+SQUAWK_CONSTRUCT_CYCLES(SQUAWK_CYCLES_GRIND + SQUAWK_CYCLES_MIX + SQUAWK_CYCLES_##W0 + SQUAWK_CYCLES_##W1 + SQUAWK_CYCLES_##W2 + SQUAWK_CYCLES_##W3) \
+uint8_t squawk_grind() { \
+  uint8_t  hi, sample; \
+  uint16_t lfsr; \
+  (void)hi; (void)lfsr; \
 \
-    "lds  r18,                   osc+2*%[mul]+%[fre]  " "\n\t" \
-    "lds  r0,                    osc+2*%[mul]+%[pha]  " "\n\t" \
-    "add  r0,                    r18                  " "\n\t" \
-    "sts  osc+2*%[mul]+%[pha],   r0                   " "\n\t" \
-    "lds  r18,                   osc+2*%[mul]+%[fre]+1" "\n\t" \
-    "lds  r1,                    osc+2*%[mul]+%[pha]+1" "\n\t" \
-    "adc  r1,                    r18                  " "\n\t" \
-    "sts  osc+2*%[mul]+%[pha]+1, r1                   " "\n\t" \
+  SQUAWK_GRIND_MIX \
+  SQUAWK_GRIND_##W0(0) \
+  SQUAWK_GRIND_##W1(1) \
+  SQUAWK_GRIND_##W2(2) \
+  SQUAWK_GRIND_##W3(3) \
 \
-    "mov  r27,                   r1                   " "\n\t" \
-    "sbrc r27,                   7                    " "\n\t" \
-    "com  r27                                         " "\n\t" \
-    "lsl  r27                                         " "\n\t" \
-    "lds  r26,                   osc+2*%[mul]+%[vol]  " "\n\t" \
-    "subi r27,                   128                  " "\n\t" \
-    "muls r27,                   r26                  " "\n\t" \
-    "lsl  r1                                          " "\n\t" \
-    "mov  r26,                   r1                   " "\n\t" \
+  TARGET_REGISTER = sample; \
 \
-    "lds  r18,                   osc+0*%[mul]+%[fre]  " "\n\t" \
-    "lds  r0,                    osc+0*%[mul]+%[pha]  " "\n\t" \
+  if(--cia_count == 0) { \
+    cia_count = cia; \
+    squawk_playroutine(); \
+  } \
+  SQUAWK_GRIND_REFILL \
+  return sample; \
+}
+
+// Buffered version, plays samples rendered by squawk_render() one buffer
+// half earlier
+#define SQUAWK_CONSTRUCT_BUFFERED_ISR(TARGET_REGISTER) \
+uint16_t cia; \
+uint16_t cia_count; \
+intptr_t squawk_register = (intptr_t)&TARGET_REGISTER; \
+SQUAWK_CONSTRUCT_MASKS(PULSE, SQUARE, TRIANGLE, NOISE) \
+SQUAWK_CONSTRUCT_CYCLES(43) \
+SQUAWK_CONSTRUCT_REFILL() \
+uint8_t squawk_grind() { \
+  uint8_t sample = squawk_buffer[squawk_buffer_ix] ^ 0x80; \
+  TARGET_REGISTER = sample; \
+  squawk_buffer_ix = (squawk_buffer_ix + 1) & (SQUAWK_BUFFER_SIZE - 1); \
+  if((squawk_buffer_ix & (SQUAWK_BUFFER_SIZE / 2 - 1)) == 0) squawk_refill(); \
+  return sample; \
+}
+
+#else
+
+// SAMPLE GRINDER
+// generates samples and updates oscillators
+// uses 138 cycles (not counting playroutine) with all four channels,
+// interrupt entry included - counted from the instructions, not measured
+//     ~38% CPU @ 44.1kHz on 16MHz
+// each channel taken out (OFF) drops 19 to 25 cycles of instructions
+// a TABLE or TABLE_RAM channel costs 15 to 17 cycles more than a triangle
+
+// Waveforms, each adds output of oscillator N to r26
+#define SQUAWK_GRIND_PHASE(N) \
+    "lds  r18,                   osc+" #N "*%[mul]+%[fre]  " "\n\t" \
+    "lds  r0,                    osc+" #N "*%[mul]+%[pha]  " "\n\t" \
     "add  r0,                    r18                  " "\n\t" \
-    "sts  osc+0*%[mul]+%[pha],   r0                   " "\n\t" \
-    "lds  r18,                   osc+0*%[mul]+%[fre]+1" "\n\t" \
-    "lds  r1,                    osc+0*%[mul]+%[pha]+1" "\n\t" \
+    "sts  osc+" #N "*%[mul]+%[pha],   r0                   " "\n\t" \
+    "lds  r18,                   osc+" #N "*%[mul]+%[fre]+1" "\n\t" \
+    "lds  r1,                    osc+" #N "*%[mul]+%[pha]+1" "\n\t" \
     "adc  r1,                    r18                  " "\n\t" \
-    "sts  osc+0*%[mul]+%[pha]+1, r1                   " "\n\t" \
-\
+    "sts  osc+" #N "*%[mul]+%[pha]+1, r1                   " "\n\t"
+
+#define SQUAWK_GRIND_OFF(N)
+
+#define SQUAWK_GRIND_PULSE(N) \
+    SQUAWK_GRIND_PHASE(N) \
     "mov  r18,                   r1                   " "\n\t" \
     "lsl  r18                                         " "\n\t" \
     "and  r18,                   r1                   " "\n\t" \
-    "lds  r27,                   osc+0*%[mul]+%[vol]  " "\n\t" \
+    "lds  r27,                   osc+" #N "*%[mul]+%[vol]  " "\n\t" \
     "sbrc r18,                   7                    " "\n\t" \
     "neg  r27                                         " "\n\t" \
-    "add  r26,                   r27                  " "\n\t" \
-\
-    "lds  r18,                   osc+1*%[mul]+%[fre]  " "\n\t" \
-    "lds  r0,                    osc+1*%[mul]+%[pha]  " "\n\t" \
-    "add  r0,                    r18                  " "\n\t" \
-    "sts  osc+1*%[mul]+%[pha],   r0                   " "\n\t" \
-    "lds  r18,                   osc+1*%[mul]+%[fre]+1" "\n\t" \
-    "lds  r1,                    osc+1*%[mul]+%[pha]+1" "\n\t" \
-    "adc  r1,                    r18                  " "\n\t" \
-    "sts  osc+1*%[mul]+%[pha]+1, r1                   " "\n\t" \
-\
-    "lds  r27,                   osc+1*%[mul]+%[vol]  " "\n\t" \
+    "add  r26,                   r27                  " "\n\t"
+
+#define SQUAWK_GRIND_SQUARE(N) \
+    SQUAWK_GRIND_PHASE(N) \
+    "lds  r27,                   osc+" #N "*%[mul]+%[vol]  " "\n\t" \
     "sbrc r1,                    7                    " "\n\t" \
     "neg  r27                                         " "\n\t" \
-    "add  r26,                   r27                  " "\n\t" \
-\
+    "add  r26,                   r27                  " "\n\t"
+
+#define SQUAWK_GRIND_TRIANGLE(N) \
+    SQUAWK_GRIND_PHASE(N) \
+    "mov  r27,                   r1                   " "\n\t" \
+    "sbrc r27,                   7                    " "\n\t" \
+    "com  r27                                         " "\n\t" \
+    "lsl  r27                                         " "\n\t" \
+    "lds  r18,                   osc+" #N "*%[mul]+%[vol]  " "\n\t" \
+    "subi r27,                   128                  " "\n\t" \
+    "muls r27,                   r18                  " "\n\t" \
+    "lsl  r1                                          " "\n\t" \
+    "add  r26,                   r1                   " "\n\t"
+
+#define SQUAWK_GRIND_NOISE(N) \
     "ldi  r27,                   1                    " "\n\t" \
-    "lds  r0,                    osc+3*%[mul]+%[fre]  " "\n\t" \
-    "lds  r1,                    osc+3*%[mul]+%[fre]+1" "\n\t" \
+    "lds  r0,                    osc+" #N "*%[mul]+%[fre]  " "\n\t" \
+    "lds  r1,                    osc+" #N "*%[mul]+%[fre]+1" "\n\t" \
     "add  r0,                    r0                   " "\n\t" \
     "adc  r1,                    r1                   " "\n\t" \
     "sbrc r1,                    7                    " "\n\t" \
     "eor  r0,                    r27                  " "\n\t" \
     "sbrc r1,                    6                    " "\n\t" \
     "eor  r0,                    r27                  " "\n\t" \
-    "sts  osc+3*%[mul]+%[fre],   r0                   " "\n\t" \
-    "sts  osc+3*%[mul]+%[fre]+1, r1                   " "\n\t" \
-\
-    "lds  r27,                   osc+3*%[mul]+%[vol]  " "\n\t" \
+    "sts  osc+" #N "*%[mul]+%[fre],   r0                   " "\n\t" \
+    "sts  osc+" #N "*%[mul]+%[fre]+1, r1                   " "\n\t" \
+    "lds  r27,                   osc+" #N "*%[mul]+%[vol]  " "\n\t" \
     "sbrc r1,                    7                    " "\n\t" \
     "neg  r27                                         " "\n\t" \
+    "add  r26,                   r27                  " "\n\t"
+
+#ifdef SQUAWK_TABLES
+// Table entry (read by LOAD from Z) at the phase's top bits, scaled as the
+// triangle wave is - Z is saved around it
+#if SQUAWK_TABLE_SIZE == 64
+#define SQUAWK_GRIND_TABLE_SHIFT \
+    "lsr  r27                                         " "\n\t" \
+    "lsr  r27                                         " "\n\t"
+#else
+#define SQUAWK_GRIND_TABLE_SHIFT \
+    "lsr  r27                                         " "\n\t" \
+    "lsr  r27                                         " "\n\t" \
+    "lsr  r27                                         " "\n\t"
+#endif
+#define SQUAWK_GRIND_TABLE_LOOKUP(N, LOAD) \
+    SQUAWK_GRIND_PHASE(N) \
+    "push r30                                         " "\n\t" \
+    "push r31                                         " "\n\t" \
+    "lds  r30,                   osc+" #N "*%[mul]+%[tab]  " "\n\t" \
+    "lds  r31,                   osc+" #N "*%[mul]+%[tab]+1" "\n\t" \
+    "mov  r27,                   r1                   " "\n\t" \
+    SQUAWK_GRIND_TABLE_SHIFT \
+    "ldi  r18,                   0                    " "\n\t" \
+    "add  r30,                   r27                  " "\n\t" \
+    "adc  r31,                   r18                  " "\n\t" \
+    LOAD "\n\t" \
+    "pop  r31                                         " "\n\t" \
+    "pop  r30                                         " "\n\t" \
+    "lds  r18,                   osc+" #N "*%[mul]+%[vol]  " "\n\t" \
+    "muls r27,                   r18                  " "\n\t" \
+    "lsl  r1                                          " "\n\t" \
+    "add  r26,                   r1                   " "\n\t"
+
+#define SQUAWK_GRIND_TABLE(N) \
+    SQUAWK_GRIND_TABLE_LOOKUP(N, "lpm  r27,                   Z                    ")
+
+#define SQUAWK_GRIND_TABLE_RAM(N) \
+    SQUAWK_GRIND_TABLE_LOOKUP(N, "ld   r27,                   Z                    ")
+
+// Operand for the table pointer's offset in the oscillator
+#define SQUAWK_GRIND_TABLE_OPERAND [tab] "M" (offsetof(Oscillator, table)),
+#else
+#define SQUAWK_GRIND_TABLE_OPERAND
+#endif
+
+// Start of the sample in r26: pcm, or the PCM voice's sample - stepping
+// it on, and setting T when it steps into the other buffer half, for
+// SQUAWK_GRIND_REFILL to call squawk_pcm_refill() (the playroutine, when it
+// runs instead, refills too)
+#ifdef SQUAWK_PCM
+#define SQUAWK_GRIND_MIX \
+    "clt                                              " "\n\t" \
+    "lds  r27,                   squawk_pcm_step      " "\n\t" \
+    "lds  r26,                   squawk_pcm_phase     " "\n\t" \
     "add  r26,                   r27                  " "\n\t" \
-\
-    "lds  r27,                   pcm                  " "\n\t" \
-    "add  r26,                   r27                  " "\n\t" \
-    "sts  %[reg],                r26                  " "\n\t" \
-\
-	  "lds  r27,                   cia_count+1          " "\n\t" \
-	  "lds  r26,                   cia_count            " "\n\t" \
-	  "sbiw r26,                   1                    " "\n\t" \
-	  "breq call_playroutine                            " "\n\t" \
-	  "sts  cia_count+1,           r27                  " "\n\t" \
-	  "sts  cia_count,             r26                  " "\n\t" \
-    "pop  r1                                          " "\n\t" \
-    "pop  r0                                          " "\n\t" \
-    "pop  r26                                         " "\n\t" \
-    "pop  r27                                         " "\n\t" \
-    "pop  r18                                         " "\n\t" \
-    "out  __SREG__,              r2                   " "\n\t" \
-    "pop  r2                                          " "\n\t" \
-	  "reti                                             " "\n\t" \
-    "call_playroutine:                                " "\n\t" \
-\
-	  "lds  r27, cia+1                                  " "\n\t" \
-	  "lds  r26, cia                                    " "\n\t" \
-	  "sts  cia_count+1,           r27                  " "\n\t" \
-	  "sts  cia_count,             r26                  " "\n\t" \
-\
+    "sts  squawk_pcm_phase,      r26                  " "\n\t" \
+    "lds  r26,                   squawk_pcm_ix        " "\n\t" \
+    "brcc pcm_load                                    " "\n\t" \
+    "inc  r26                                         " "\n\t" \
+    "andi r26,                   %[pcm_end]           " "\n\t" \
+    "sts  squawk_pcm_ix,         r26                  " "\n\t" \
+    "mov  r27,                   r26                  " "\n\t" \
+    "andi r27,                   %[pcm_half]          " "\n\t" \
+    "brne pcm_load                                    " "\n\t" \
+    "set                                              " "\n\t" \
+    "pcm_load:                                        " "\n\t" \
+    "ldi  r27,                   0                    " "\n\t" \
+    "subi r26,                   lo8(-(squawk_pcm_buffer))" "\n\t" \
+    "sbci r27,                   hi8(-(squawk_pcm_buffer))" "\n\t" \
+    "ld   r26,                   X                    " "\n\t"
+#define SQUAWK_GRIND_REFILL \
+    "brts call_pcm_refill                             " "\n\t"
+#define SQUAWK_GRIND_REFILL_CALL \
+    "call_pcm_refill:                                 " "\n\t" \
+    SQUAWK_GRIND_CALL(squawk_pcm_refill)
+#else
+#define SQUAWK_GRIND_MIX \
+    "lds  r26,                   pcm                  " "\n\t"
+#define SQUAWK_GRIND_REFILL
+#define SQUAWK_GRIND_REFILL_CALL
+#endif
+
+// Calls FUNCTION with interrupts enabled, and returns from the interrupt
+#define SQUAWK_GRIND_CALL(FUNCTION) \
     "sei                                              " "\n\t" \
 	  "push r19                                         " "\n\t" \
 	  "push r20                                         " "\n\t" \
@@ -241,7 +708,7 @@ ISR(TIMER1_COMPA_vect, ISR_NAKED) { \
 	  "push r31                                         " "\n\t" \
 \
     "clr  r1                                          " "\n\t" \
-    "call squawk_playroutine                          " "\n\t" \
+    "call " #FUNCTION "                                  " "\n\t" \
 \
 	  "pop  r31                                         " "\n\t" \
 	  "pop  r30                                         " "\n\t" \
@@ -253,6 +720,46 @@ ISR(TIMER1_COMPA_vect, ISR_NAKED) { \
 	  "pop  r20                                         " "\n\t" \
 	  "pop  r19                                         " "\n\t" \
 \
+    "pop  r1                                          " "\n\t" \
+    "pop  r0                                          " "\n\t" \
+    "pop  r26                                         " "\n\t" \
+    "pop  r27                                         " "\n\t" \
+    "pop  r18                                         " "\n\t" \
+    "out  __SREG__,              r2                   " "\n\t" \
+    "pop  r2                                          " "\n\t" \
+	  "reti                                             " "\n\t"
+
+//ISR(TIMER4_OVF_vect, ISR_NAKED) { // For Arduboy
+#define SQUAWK_CONSTRUCT_ISR_EX(TARGET_REGISTER, W0, W1, W2, W3) \
+uint16_t cia __attribute__((used)); \
+uint16_t cia_count __attribute__((used)); \
+intptr_t squawk_register __attribute__((used)) = (intptr_t)&TARGET_REGISTER; \
+SQUAWK_CONSTRUCT_MASKS(W0, W1, W2, W3) \
+SQUAWK_CONSTRUCT_CYCLES(SQUAWK_CYCLES_GRIND + SQUAWK_CYCLES_MIX + SQUAWK_CYCLES_##W0 + SQUAWK_CYCLES_##W1 + SQUAWK_CYCLES_##W2 + SQUAWK_CYCLES_##W3) \
+ISR(TIMER1_COMPA_vect, ISR_NAKED) { \
+  asm volatile( \
+    "push r2                                          " "\n\t" \
+    "in   r2,                    __SREG__             " "\n\t" \
+    "push r18                                         " "\n\t" \
+    "push r27                                         " "\n\t" \
+    "push r26                                         " "\n\t" \
+    "push r0                                          " "\n\t" \
+    "push r1                                          " "\n\t" \
+\
+    SQUAWK_GRIND_MIX \
+    SQUAWK_GRIND_##W0(0) \
+    SQUAWK_GRIND_##W1(1) \
+    SQUAWK_GRIND_##W2(2) \
+    SQUAWK_GRIND_##W3(3) \
+    "sts  %[reg],                r26                  " "\n\t" \
+\
+	  "lds  r27,                   cia_count+1          " "\n\t" \
+	  "lds  r26,                   cia_count            " "\n\t" \
+	  "sbiw r26,                   1                    " "\n\t" \
+	  "breq call_playroutine                            " "\n\t" \
+	  "sts  cia_count+1,           r27                  " "\n\t" \
+	  "sts  cia_count,             r26                  " "\n\t" \
+    SQUAWK_GRIND_REFILL \
     "pop  r1                                          " "\n\t" \
     "pop  r0                                          " "\n\t" \
     "pop  r26                                         " "\n\t" \
@@ -261,13 +768,109 @@ ISR(TIMER1_COMPA_vect, ISR_NAKED) { \
     "out  __SREG__,              r2                   " "\n\t" \
     "pop  r2                                          " "\n\t" \
 	  "reti                                             " "\n\t" \
+    "call_playroutine:                                " "\n\t" \
+\
+	  "lds  r27, cia+1                                  " "\n\t" \
+	  "lds  r26, cia                                    " "\n\t" \
+	  "sts  cia_count+1,           r27                  " "\n\t" \
+	  "sts  cia_count,             r26                  " "\n\t" \
+\
+    SQUAWK_GRIND_CALL(squawk_playroutine) \
+    SQUAWK_GRIND_REFILL_CALL \
     : \
     : [reg] "M" _SFR_MEM_ADDR(TARGET_REGISTER), \
       [mul] "M" (sizeof(Oscillator)), \
       [pha] "M" (offsetof(Oscillator, phase)), \
       [fre] "M" (offsetof(Oscillator, freq)), \
-      [vol] "M" (offsetof(Oscillator, vol)) \
+      [vol] "M" (offsetof(Oscillator, vol)), \
+      SQUAWK_GRIND_TABLE_OPERAND \
+      [pcm_end] "M" (SQUAWK_PCM_BUFFER - 1), \
+      [pcm_half] "M" (SQUAWK_PCM_BUFFER / 2 - 1) \
   ); \
 }
 
+// BUFFERED SAMPLE GRINDER
+// plays samples from a buffer, rendered by squawk_render() half a buffer
+// at a time with interrupts enabled, the playroutine included
+// uses 43 cycles per sample (interrupt entry included, counted from the
+// instructions - not measured yet), plus the refill every
+// SQUAWK_BUFFER_SIZE / 2 samples
+#define SQUAWK_CONSTRUCT_BUFFERED_ISR(TARGET_REGISTER) \
+uint16_t cia __attribute__((used)); \
+uint16_t cia_count __attribute__((used)); \
+intptr_t squawk_register __attribute__((used)) = (intptr_t)&TARGET_REGISTER; \
+SQUAWK_CONSTRUCT_MASKS(PULSE, SQUARE, TRIANGLE, NOISE) \
+SQUAWK_CONSTRUCT_CYCLES(43) \
+SQUAWK_CONSTRUCT_REFILL() \
+ISR(TIMER1_COMPA_vect, ISR_NAKED) { \
+  asm volatile( \
+    "push r31                                         " "\n\t" \
+    "in   r31,                   __SREG__             " "\n\t" \
+    "push r31                                         " "\n\t" \
+    "push r30                                         " "\n\t" \
+\
+    "lds  r30,                   squawk_buffer_ix     " "\n\t" \
+    "ldi  r31,                   0                    " "\n\t" \
+    "subi r30,                   lo8(-(squawk_buffer))" "\n\t" \
+    "sbci r31,                   hi8(-(squawk_buffer))" "\n\t" \
+    "ld   r31,                   Z                    " "\n\t" \
+    "subi r31,                   0x80                 " "\n\t" \
+    "sts  %[reg],                r31                  " "\n\t" \
+\
+    "lds  r30,                   squawk_buffer_ix     " "\n\t" \
+    "inc  r30                                         " "\n\t" \
+    "andi r30,                   %[end]               " "\n\t" \
+    "sts  squawk_buffer_ix,      r30                  " "\n\t" \
+    "andi r30,                   %[half]              " "\n\t" \
+    "breq call_refill                                 " "\n\t" \
+    "pop  r30                                         " "\n\t" \
+    "pop  r31                                         " "\n\t" \
+    "out  __SREG__,              r31                  " "\n\t" \
+    "pop  r31                                         " "\n\t" \
+    "reti                                             " "\n\t" \
+    "call_refill:                                     " "\n\t" \
+\
+    "push r0                                          " "\n\t" \
+    "push r1                                          " "\n\t" \
+    "push r18                                         " "\n\t" \
+    "push r19                                         " "\n\t" \
+    "push r20                                         " "\n\t" \
+    "push r21                                         " "\n\t" \
+    "push r22                                         " "\n\t" \
+    "push r23                                         " "\n\t" \
+    "push r24                                         " "\n\t" \
+    "push r25                                         " "\n\t" \
+    "push r26                                         " "\n\t" \
+    "push r27                                         " "\n\t" \
+    "sei                                              " "\n\t" \
+\
+    "clr  r1                                          " "\n\t" \
+    "call squawk_refill                               " "\n\t" \
+\
+    "pop  r27                                         " "\n\t" \
+    "pop  r26                                         " "\n\t" \
+    "pop  r25                                         " "\n\t" \
+    "pop  r24                                         " "\n\t" \
+    "pop  r23                                         " "\n\t" \
+    "pop  r22                                         " "\n\t" \
+    "pop  r21                                         " "\n\t" \
+    "pop  r20                                         " "\n\t" \
+    "pop  r19                                         " "\n\t" \
+    "pop  r18                                         " "\n\t" \
+    "pop  r1                                          " "\n\t" \
+    "pop  r0                                          " "\n\t" \
+    "pop  r30                                         " "\n\t" \
+    "pop  r31                                         " "\n\t" \
+    "out  __SREG__,              r31                  " "\n\t" \
+    "pop  r31                                         " "\n\t" \
+    "reti                                             " "\n\t" \
+    : \
+    : [reg]  "M" _SFR_MEM_ADDR(TARGET_REGISTER), \
+      [end]  "M" (SQUAWK_BUFFER_SIZE - 1), \
+      [half] "M" (SQUAWK_BUFFER_SIZE / 2 - 1) \
+  ); \
+}
+
+#endif
+
 #endif
\ No newline at end of file
@@ -8,6 +8,7 @@ class StreamFile : public SquawkStream {
 	public:
 		StreamFile(File file = File()) { f = file; }
     uint8_t read() { return f.read(); }
+    void read(uint8_t *p_dst, uint8_t count) { f.read(p_dst, count); }
     void seek(size_t offset) { f.seek(offset); }
 };
 
@@ -21,6 +22,20 @@ void SquawkSynthSD::play(File melody) {
 	SquawkSynth::play(&file);
 }
 
+bool SquawkSynthSD::play(File melody, uint8_t *buffer, size_t size) {
+	uint32_t length = melody.size();
+	SquawkSynth::pause();
+	if(length <= size) {
+		melody.seek(0);
+		if(melody.read(buffer, length) == (int)length) {
+			SquawkSynth::playRAM(buffer);
+			return true;
+		}
+	}
+	play(melody);
+	return false;
+}
+
 void SquawkSynthSD::convert(File in, File out) {
   unsigned int n;
   uint8_t patterns = 0, order_count;
@@ -9,6 +9,9 @@ class SquawkSynthSD : public SquawkSynth {
 	public:
 	  inline void play() { Squawk.play(); };
 		void play(File file);
+		// Load file into buffer (size bytes) and play it from RAM, leaving the
+		// SD card free - or play it from SD card if it doesn't fit, returns false
+		bool play(File file, uint8_t *buffer, size_t size);
 		void convert(File in, File out);
 };
 
@@ -10,6 +10,8 @@ class StreamFile : public SquawkStream {
 	public:
 		StreamFile(Fat16 file = Fat16()) { f = file; }
     uint8_t read() { return f.read(); }
+    // Whole rows at once, Fat16 finds the block for every read() call
+    void read(uint8_t *p_dst, uint8_t count) { f.read(p_dst, count); }
     void seek(size_t offset) { f.seekSet(offset); }
 };
 
@@ -19,4 +21,17 @@ void SquawkSynthSD16::play(Fat16 melody) {
 	SquawkSynth::pause();
 	file = StreamFile(melody);
 	SquawkSynth::play(&file);
+}
+
+bool SquawkSynthSD16::play(Fat16 melody, uint8_t *buffer, size_t size) {
+	uint32_t length = melody.fileSize();
+	SquawkSynth::pause();
+	if(length <= size && melody.seekSet(0)) {
+		if(melody.read(buffer, length) == (int16_t)length) {
+			SquawkSynth::playRAM(buffer);
+			return true;
+		}
+	}
+	play(melody);
+	return false;
 }
\ No newline at end of file
@@ -29,6 +29,9 @@ class SquawkSynthSD16 : public SquawkSynth {
 	public:
 	  inline void play() { Squawk.play(); };
 		void play(Fat16 file);
+		// Load file into buffer (size bytes) and play it from RAM, leaving the
+		// SD card free - or play it from SD card if it doesn't fit, returns false
+		bool play(Fat16 file, uint8_t *buffer, size_t size);
 };
 
 extern SquawkSynthSD16 SquawkSD;
@@ -0,0 +1,127 @@
+#include <SquawkSRAM.h>
+
+SquawkSynthSRAM SquawkSRAM;
+
+// 23LC1024 commands, FRAM takes the same ones - and WRMR as WRSR, which it
+// ignores without WREN first
+#define SRAM_WRITE      0x02
+#define SRAM_READ       0x03
+#define SRAM_WRMR       0x01
+#define SRAM_WREN       0x06
+#define SRAM_SEQUENTIAL 0x40
+
+// Clocks a byte out
+static void sram_send(uint8_t b) {
+  SPDR = b;
+  while (!(SPSR & (1 << SPIF)));
+}
+
+// Selects the memory and sends command with address, SPI at F_CPU/2 like
+// SdCard leaves it - the SD card can have changed it since
+static void sram_command(uint8_t cs, uint8_t command, uint32_t address) {
+  SPCR = (1 << SPE) | (1 << MSTR);
+  SPSR |= (1 << SPI2X);
+  digitalWrite(cs, LOW);
+  sram_send(command);
+  for(int8_t s = (SQUAWK_SRAM_ADDRESS - 1) * 8; s >= 0; s -= 8) sram_send(address >> s);
+}
+
+// Sets up the SPI pins, as SdCard::init() does, and puts the memory in
+// sequential mode, for reads and writes of any length
+static void sram_init(uint8_t cs) {
+  pinMode(cs, OUTPUT);
+  digitalWrite(cs, HIGH);
+  pinMode(SPI_MISO_PIN, INPUT);
+  pinMode(SPI_SS_PIN, OUTPUT);
+  pinMode(SPI_MOSI_PIN, OUTPUT);
+  pinMode(SPI_SCK_PIN, OUTPUT);
+  SPCR = (1 << SPE) | (1 << MSTR);
+  digitalWrite(cs, LOW);
+  sram_send(SRAM_WRMR);
+  sram_send(SRAM_SEQUENTIAL);
+  digitalWrite(cs, HIGH);
+}
+
+// Reads count (1-255) bytes at address, in one transaction
+static void sram_read(uint8_t cs, uint32_t address, uint8_t *p_dst, uint8_t count) {
+  sram_command(cs, SRAM_READ, address);
+  // Store each byte while the next is clocked in, as SdCard does
+  SPDR = 0xFF;
+  while(--count) {
+    while (!(SPSR & (1 << SPIF)));
+    *p_dst++ = SPDR;
+    SPDR = 0xFF;
+  }
+  while (!(SPSR & (1 << SPIF)));
+  *p_dst = SPDR;
+  digitalWrite(cs, HIGH);
+}
+
+class StreamSRAM : public SquawkStream {
+  private:
+    uint8_t  cs;
+    uint32_t base;
+    size_t   cursor;
+    size_t   block_start;         // Stream position of block[0]
+    uint8_t  block_size;          // Bytes in block, 0 before the first read
+    uint8_t  block[SQUAWK_SRAM_BLOCK];
+    // Reads the block at the cursor
+    void fetch() {
+      sram_read(cs, base + cursor, block, SQUAWK_SRAM_BLOCK);
+      block_start = cursor;
+      block_size  = SQUAWK_SRAM_BLOCK;
+    }
+  public:
+    StreamSRAM() { open(0, 0); }
+    // Starts over at address, without copying the block around
+    void open(uint8_t chip_select, uint32_t address) {
+      cs = chip_select;
+      base = address;
+      cursor = block_start = 0;
+      block_size = 0;
+    }
+    uint8_t read() {
+      if(cursor - block_start >= block_size) fetch();
+      return block[cursor++ - block_start];
+    }
+    void read(uint8_t *p_dst, uint8_t count) {
+      uint8_t n;
+      // More than a block, straight from the memory
+      if(count > SQUAWK_SRAM_BLOCK) {
+        sram_read(cs, base + cursor, p_dst, count);
+        cursor += count;
+        return;
+      }
+      while(count) {
+        if(cursor - block_start >= block_size) fetch();
+        n = block_size - (cursor - block_start);
+        if(n > count) n = count;
+        memcpy(p_dst, &block[cursor - block_start], n);
+        p_dst  += n;
+        cursor += n;
+        count  -= n;
+      }
+    }
+    void seek(size_t offset) { cursor = offset; }
+    // Only service() reads, so SPI traffic never cuts into the sketch's
+    bool readInISR() { return false; }
+};
+
+static StreamSRAM sram;
+
+void SquawkSynthSRAM::play(uint8_t chip_select, uint32_t address) {
+  SquawkSynth::pause();
+  sram_init(chip_select);
+  sram.open(chip_select, address);
+  SquawkSynth::play(&sram);
+}
+
+void SquawkSynthSRAM::write(uint8_t chip_select, uint32_t address, const uint8_t *data, size_t size) {
+  sram_init(chip_select);
+  digitalWrite(chip_select, LOW);
+  sram_send(SRAM_WREN);
+  digitalWrite(chip_select, HIGH);
+  sram_command(chip_select, SRAM_WRITE, address);
+  while(size--) sram_send(*data++);
+  digitalWrite(chip_select, HIGH);
+}
@@ -0,0 +1,43 @@
+/**
+SquawkSRAM
+
+Plays melodies from SPI SRAM or FRAM (23LC1024 and the like), for melodies
+too large for flash that should not keep the SD card busy. Rows are read
+ahead a block at a time, each block with one sequential read.
+
+Uses the SPI pins of the Fat16 library (see SdCard.h), the memory can share
+the bus with the SD card on its own chip select pin. To keep the two apart,
+the sample interrupt never touches the bus: only Squawk.service() reads the
+memory, so call it often from loop(), between SD card accesses - playback
+holds when it has no row ready.
+*/
+#ifndef _SQUAWKSRAM_H_
+#define _SQUAWKSRAM_H_
+#include <Squawk.h>
+#include <SdCard.h>
+
+// Address bytes the memory takes: 3 for 23LC1024 and FRAM from 1Mbit up,
+// 2 for 23K256, 23LC512 and smaller FRAM
+#ifndef SQUAWK_SRAM_ADDRESS
+#define SQUAWK_SRAM_ADDRESS 3
+#endif
+
+// Bytes read per transaction - 4 rows
+#ifndef SQUAWK_SRAM_BLOCK
+#define SQUAWK_SRAM_BLOCK 36
+#endif
+
+class SquawkSynthSRAM : public SquawkSynth {
+  public:
+    inline void play() { Squawk.play(); };
+    // Play the melody (a .sqm file, or a melody array) stored at address in
+    // the memory on chip_select - read by Squawk.service() alone
+    void play(uint8_t chip_select, uint32_t address);
+    // Store size bytes in the memory on chip_select, at address - not while
+    // playing from it
+    void write(uint8_t chip_select, uint32_t address, const uint8_t *data, size_t size);
+};
+
+extern SquawkSynthSRAM SquawkSRAM;
+
+#endif
@@ -69,5 +69,7 @@ void setup() {
 }
 
 void loop() {
+  // Read ahead in the melody file, away from the sample interrupt
+  SquawkSD.service();
   // Do whatever you want
 }
@@ -0,0 +1,37 @@
+/* === SQUAWK BENCHMARK FIRMWARE === */
+
+#include <Squawk.h>
+
+/*
+Firmware for the cycle benchmark in convert/src/squawk-bench.c, which runs
+it inside simavr and times the sample grinder and squawk_playroutine().
+
+It is built by convert/src/squawk-bench.sh, once per module and sample rate:
+  melody.h           is generated next to this file by mod2squawk -a
+  SQUAWK_BENCH_RATE  is passed on the compiler command line
+  SQUAWK_BENCH_BUFFERED may be, to measure the buffered sample grinder
+
+Nothing else runs, so every cycle measured is spent by Squawk.
+*/
+
+#ifndef SQUAWK_BENCH_RATE
+#define SQUAWK_BENCH_RATE 32000
+#endif
+
+// Configure Squawk for PWM output, and construct suitable ISR.
+#ifdef SQUAWK_BENCH_BUFFERED
+SQUAWK_CONSTRUCT_BUFFERED_ISR(SQUAWK_PWM_PIN3)
+#else
+SQUAWK_CONSTRUCT_ISR(SQUAWK_PWM_PIN3)
+#endif
+
+// Melody under test, named InsertTitleHere by mod2squawk
+#include "melody.h"
+
+void setup() {
+  Squawk.begin(SQUAWK_BENCH_RATE);
+  Squawk.play(InsertTitleHere);
+}
+
+void loop() {
+}